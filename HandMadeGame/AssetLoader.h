@@ -0,0 +1,146 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <utility>
+
+#include "utilDefs.h"
+#include "Image.h"
+#include "ThreadPool.h"
+
+namespace voi {
+
+	enum class AssetState : ui8 {
+		LOADING,
+		READY,
+		FAILED,
+		CANCELLED
+	};
+
+	class AssetHandle;
+
+	/*---------- shared between the loader, its worker and every handle copy ------------*/
+
+	struct AssetSlot {
+		std::string path;
+		int priority = 0;
+
+		//only read and written on the main loop thread
+		AssetState state = AssetState::LOADING;
+		Image image;
+
+		std::atomic<bool> cancelled{ false };
+		std::function<void(AssetHandle&)> onReady;
+	};
+
+	/*---------- cheap to copy reference to an image that may still be loading ------------*/
+
+	class AssetHandle {
+		std::shared_ptr<AssetSlot> slot;
+
+		friend class AssetLoader;
+		AssetHandle(std::shared_ptr<AssetSlot> s) : slot(std::move(s)) {}
+
+	public:
+		AssetHandle() {}
+
+		bool valid() const { return slot != nullptr; }
+		AssetState state() const { return slot ? slot->state : AssetState::FAILED; }
+		bool ready() const { return slot && slot->state == AssetState::READY; }
+		bool loading() const { return slot && slot->state == AssetState::LOADING; }
+
+		const std::string& path() const { return slot->path; }
+
+		/*only meaningful once ready, empty before*/
+		const Image& image() const { return slot->image; }
+		Image& image() { return slot->image; }
+	};
+
+	/*---------------------------------------------------------------------------------------
+	   Reads and decodes images on a thread pool. Loads return a handle right away, the
+	   image is filled and its state changes only inside Deliver, which the engine calls
+	   once per frame from the main loop thread, so handles and callbacks never need locks
+	   and never see a half written image.
+	---------------------------------------------------------------------------------------*/
+
+	class AssetLoader {
+		std::mutex lock;
+		std::vector<std::pair<std::shared_ptr<AssetSlot>, Image>> finished;	// decoded, the images wait here for Deliver
+		std::atomic<ui32> inFlight{ 0 };
+
+		//last member so its workers are joined before the rest is destroyed
+		ThreadPool pool;
+
+	public:
+		using Callback = std::function<void(AssetHandle&)>;
+
+		AssetLoader(ui32 threads = 0) : pool(threads) {}
+
+		AssetLoader(const AssetLoader& other) = delete;
+		void operator = (const AssetLoader& other) = delete;
+
+		/*queues the image at path, higher priorities are decoded first, onReady runs in Deliver when it succeeds*/
+		AssetHandle Load(const char* path, int priority = 0, Callback onReady = {}) {
+			std::shared_ptr<AssetSlot> slot = std::make_shared<AssetSlot>();
+			slot->path = path;
+			slot->priority = priority;
+			slot->onReady = std::move(onReady);
+
+			inFlight++;
+
+			pool.submit([this, slot]() {
+				//cancelled before a worker got to it, skip the decode
+				Image img;
+				if (!slot->cancelled) img = Image::ReadDecodeImage(slot->path.c_str());
+
+				//the slot belongs to the main loop thread, the image only moves into it in Deliver
+				std::lock_guard<std::mutex> guard(lock);
+				finished.emplace_back(slot, std::move(img));
+			}, priority);
+
+			return AssetHandle(slot);
+		}
+
+		/*the image is dropped when it arrives and its callback never runs*/
+		void Cancel(AssetHandle& handle) {
+			if (!handle.slot || handle.slot->state != AssetState::LOADING) return;
+
+			handle.slot->cancelled = true;
+			handle.slot->state = AssetState::CANCELLED;
+		}
+
+		/*loads queued or decoding right now*/
+		ui32 Pending() const { return inFlight; }
+
+		/*main loop thread only, publishes every finished load and runs its callback*/
+		void Deliver() {
+			std::vector<std::pair<std::shared_ptr<AssetSlot>, Image>> done;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (finished.empty()) return;
+				done.swap(finished);
+			}
+
+			for (auto& entry : done) {
+				std::shared_ptr<AssetSlot>& slot = entry.first;
+				inFlight--;
+
+				//a cancelled image goes away with done
+				if (slot->cancelled) continue;
+
+				slot->image = std::move(entry.second);
+				slot->state = slot->image.data() ? AssetState::READY : AssetState::FAILED;
+
+				if (slot->state == AssetState::READY && slot->onReady) {
+					AssetHandle handle(slot);
+					slot->onReady(handle);
+				}
+				slot->onReady = nullptr;
+			}
+		}
+	};
+}
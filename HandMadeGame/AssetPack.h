@@ -0,0 +1,258 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "Image.h"
+#include "MappedFile.h"
+#include "LZ4.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   .vpak layout, all little endian:
+	     PackHeader
+	     PackEntry[entryCount]     sorted by name hash
+	     char[nameBytes]           zero terminated names, as given to Build
+	     entry data                each one starts on a PACK_ALIGNMENT boundary, either the
+	                               decoded Pixel rows (bottom-up like Image) or their LZ4 block
+	---------------------------------------------------------------------------------------*/
+
+	struct PackHeader {
+		char magic[4];
+		ui16 version;
+		ui16 reserved;
+		ui32 entryCount;
+		ui32 nameBytes;
+		ui64 indexOffset;
+		ui64 namesOffset;
+	};
+
+	struct PackEntry {
+		ui64 nameHash;
+		ui32 nameOffset;	// from namesOffset
+		ui32 nameLength;
+		i32 width;
+		i32 height;
+		ui32 flags;
+		ui32 reserved;
+		ui64 dataOffset;
+		ui64 storedSize;	// bytes in the file, width * height * 4 unless compressed
+	};
+
+	enum PackEntryFlags : ui32 {
+		PACK_ALPHA = 0x1,
+		PACK_LZ4 = 0x2,
+		PACK_PREMULTIPLIED = 0x4
+	};
+
+	/*---------------------------------------------------------------------------------------
+	   Read side of an asset pack. The whole file is mapped copy on write, uncompressed
+	   images are handed out as Image views straight into the mapping so opening the pack
+	   and getting a sprite costs no reads or copies, pages are brought in on first touch.
+	   Views stay valid while the pack is open, writing to them never reaches the file.
+	---------------------------------------------------------------------------------------*/
+
+	class AssetPack {
+		MappedFile _file;
+
+		const PackEntry* _entries = nullptr;
+		const char* _names = nullptr;
+		ui32 _count = 0;
+		ui32 _nameBytes = 0;
+
+	public:
+		enum : ui16 { VERSION = 1 };
+		enum : ui32 { PACK_ALIGNMENT = 64 };
+
+		AssetPack() {}
+		AssetPack(const char* path) { Open(path); }
+
+		AssetPack(const AssetPack& other) = delete;
+		void operator = (const AssetPack& other) = delete;
+
+		bool Open(const char* path) {
+			Close();
+
+			if (!_file.Open(path, true)) return false;
+
+			const PackHeader* header = _file.at<PackHeader>(0);
+			if (!header || memcmp(header->magic, "VPAK", 4) || header->version != VERSION) {
+				Close();
+				return false;
+			}
+
+			_entries = _file.at<PackEntry>(header->indexOffset, header->entryCount);
+			_names = _file.at<char>(header->namesOffset, header->nameBytes);
+			if (!_entries || !_names) {
+				Close();
+				return false;
+			}
+
+			//a broken entry would make views point out of the mapping
+			for (ui32 i = 0; i < header->entryCount; i++) {
+				const PackEntry& e = _entries[i];
+				const ui64 rawSize = (ui64)e.width * e.height * sizeof(Pixel);
+				const bool sizeOk = (e.flags & PACK_LZ4) ? e.storedSize <= rawSize + rawSize / 255 + 16 : e.storedSize == rawSize;
+
+				if (e.width <= 0 || e.height <= 0 || !sizeOk || !_file.at<ui8>(e.dataOffset, e.storedSize) ||
+					(ui64)e.nameOffset + e.nameLength >= header->nameBytes || _names[e.nameOffset + e.nameLength] != '\0') {
+					Close();
+					return false;
+				}
+			}
+
+			_count = header->entryCount;
+			_nameBytes = header->nameBytes;
+			return true;
+		}
+
+		void Close() {
+			_file.Close();
+			_entries = nullptr;
+			_names = nullptr;
+			_count = 0;
+			_nameBytes = 0;
+		}
+
+		bool isOpen() const { return _file.isOpen(); }
+		ui32 count() const { return _count; }
+
+		const PackEntry& entry(ui32 index) const { return _entries[index]; }
+		const char* name(ui32 index) const { return _names + _entries[index].nameOffset; }
+
+		/*entry index of the given name, -1 if the pack does not have it*/
+		int find(const char* assetName) const {
+			const ui64 hash = NameHash(assetName);
+			const ui32 length = (ui32)strlen(assetName);
+
+			const PackEntry* end = _entries + _count;
+			const PackEntry* it = std::lower_bound(_entries, end, hash,
+				[](const PackEntry& e, ui64 h) { return e.nameHash < h; });
+
+			for (; it != end && it->nameHash == hash; it++) {
+				if (it->nameLength == length && !memcmp(_names + it->nameOffset, assetName, length)) return int(it - _entries);
+			}
+			return -1;
+		}
+
+		/*view into the pack for stored images, a decompressed copy for LZ4 ones, empty if missing*/
+		Image image(const char* assetName) {
+			int index = find(assetName);
+			return index < 0 ? Image() : image((ui32)index);
+		}
+
+		Image image(ui32 index) {
+			if (index >= _count) return Image();
+
+			const PackEntry& e = _entries[index];
+			const bool alpha = (e.flags & PACK_ALPHA) != 0;
+			const bool premultiplied = (e.flags & PACK_PREMULTIPLIED) != 0;
+
+			if (!(e.flags & PACK_LZ4)) {
+				return Image::View((Pixel*)(_file.mutableData() + e.dataOffset), e.width, e.height, alpha, premultiplied);
+			}
+
+			Image img(e.width, e.height, alpha);
+			if (!LZ4Decompress(_file.data() + e.dataOffset, e.storedSize, (ui8*)img.data(), (ui64)e.width * e.height * sizeof(Pixel))) {
+				return Image();
+			}
+			img.setPremultiplied(premultiplied);
+			return img;
+		}
+
+		static ui64 NameHash(const char* assetName) {
+			ui64 hash = 1469598103934665603ull;
+			for (const ui8* p = (const ui8*)assetName; *p; p++) {
+				hash ^= *p;
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   decodes every image and writes them into a pack, each one is named by the path it
+		   was given with. With compress, entries are stored as LZ4 blocks when that saves
+		   at least an eighth of their size, flat sprites compress well, photos do not.
+		   With premultiply, images are stored with premultiplied alpha so they are ready to
+		   blend as soon as they are mapped.
+		-----------------------------------------------------------------------------------*/
+		static bool Build(const char* packPath, const std::vector<std::string>& imagePaths, bool compress = true, bool premultiply = false) {
+			struct Pending {
+				PackEntry entry;
+				std::vector<ui8> data;
+			};
+			std::vector<Pending> pending;
+			std::string names;
+
+			for (const std::string& path : imagePaths) {
+				Image img = Image::ReadDecodeImage(path.c_str(), premultiply);
+				if (!img.data()) return false;
+
+				Pending p{};
+				p.entry.nameHash = NameHash(path.c_str());
+				p.entry.nameOffset = (ui32)names.size();
+				p.entry.nameLength = (ui32)path.size();
+				p.entry.width = img.width();
+				p.entry.height = img.height();
+				p.entry.flags = (img.alpha() ? PACK_ALPHA : 0) | (img.premultiplied() ? PACK_PREMULTIPLIED : 0);
+
+				const ui8* raw = (const ui8*)img.data();
+				const ui64 rawSize = (ui64)img.width() * img.height() * sizeof(Pixel);
+
+				if (compress) {
+					LZ4Compress(raw, rawSize, p.data);
+					if (p.data.size() <= rawSize - rawSize / 8) p.entry.flags |= PACK_LZ4;
+				}
+				if (!(p.entry.flags & PACK_LZ4)) p.data.assign(raw, raw + rawSize);
+				p.entry.storedSize = p.data.size();
+
+				names.append(path);
+				names.push_back('\0');
+				pending.push_back(std::move(p));
+			}
+
+			std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b) {
+				return a.entry.nameHash < b.entry.nameHash;
+			});
+
+			PackHeader header{ {'V','P','A','K'}, VERSION };
+			header.entryCount = (ui32)pending.size();
+			header.nameBytes = (ui32)names.size();
+			header.indexOffset = sizeof(PackHeader);
+			header.namesOffset = header.indexOffset + pending.size() * sizeof(PackEntry);
+
+			ui64 offset = header.namesOffset + names.size();
+			for (Pending& p : pending) {
+				offset = Align(offset);
+				p.entry.dataOffset = offset;
+				offset += p.entry.storedSize;
+			}
+
+			std::ofstream file(packPath, std::ios::binary);
+			if (!file) return false;
+
+			file.write((const char*)&header, sizeof(header));
+			for (const Pending& p : pending) file.write((const char*)&p.entry, sizeof(PackEntry));
+			file.write(names.data(), (std::streamsize)names.size());
+
+			static const char zeros[PACK_ALIGNMENT] = {};
+			ui64 written = header.namesOffset + names.size();
+			for (const Pending& p : pending) {
+				file.write(zeros, (std::streamsize)(p.entry.dataOffset - written));
+				file.write((const char*)p.data.data(), (std::streamsize)p.data.size());
+				written = p.entry.dataOffset + p.data.size();
+			}
+
+			return !!file;
+		}
+
+	private:
+		static ui64 Align(ui64 offset) { return (offset + PACK_ALIGNMENT - 1) & ~(ui64)(PACK_ALIGNMENT - 1); }
+	};
+}
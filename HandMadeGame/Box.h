@@ -7,7 +7,20 @@
 #include "PixelDefs.h"
 
 namespace voi {
+	class Box;
+
+	/*---------- Retained container notified when one of its widgets has to be redrawn ------------*/
+
+	class WidgetOwner {
+	public:
+		virtual void onWidgetDirty(Box* widget) = 0;
+		virtual void onWidgetMoved(Box* widget) = 0;
+		virtual void onWidgetAnimated(Box* widget, bool animated) = 0;
+	};
+
 	class Box {
+		friend class UITree;
+
 	protected:
 		VoiEngine* engine;
 		Vec4i box;
@@ -19,6 +32,43 @@ namespace voi {
 		Pixel borderColor;
 
 		bool over = false;
+
+		WidgetOwner* owner = nullptr;
+		bool dirty = false;
+		bool animated = false;
+
+	private:
+		//retained mode state, only touched by the owning UITree
+		Vec4i drawnBox;
+		bool drawn = false;
+		Image cache;
+		bool cached = false;
+		Vec4i indexedBox;
+		bool indexed = false;
+		ui32 zOrder = 0;
+
+	protected:
+
+		/*tells the owner the widget looks different, the owner repaints it on the next Render*/
+		void markDirty() {
+			if (dirty) return;
+			dirty = true;
+			if (owner) owner->onWidgetDirty(this);
+		}
+
+		/*geometry changed, the owner has to index the widget again before repainting it*/
+		void markMoved() {
+			if (owner) owner->onWidgetMoved(this);
+			markDirty();
+		}
+
+		/*animated widgets get Animate called every Render while they are set*/
+		void setAnimated(bool state) {
+			if (animated == state) return;
+			animated = state;
+			if (owner) owner->onWidgetAnimated(this, state);
+		}
+
 	public:
 		Box(): engine(NULL), box{0,0,0,0}, backColor{ 255,255,255 }, borderColor{ 0,0,0 } {}
 
@@ -32,7 +82,7 @@ namespace voi {
 		void attach(VoiEngine* engineParam) { engine = engineParam; }
 
 		void setBox(int x, int y, int w, int h) { setBox({ x,y,w,h }); }
-		virtual void setBox(Vec4i vec) { box = vec; }
+		virtual void setBox(Vec4i vec) { box = vec; markMoved(); }
 		Vec4i getBox() const { return box; }
 
 		int getX() { return box.x; }
@@ -41,31 +91,34 @@ namespace voi {
 		int getHeight() { return box.w; }
 
 		void setPos(Vec2i vec) { setPos(vec.x,vec.y); }
-		virtual void setPos(int x, int y) { box.x = x; box.y = y; }
+		virtual void setPos(int x, int y) { box.x = x; box.y = y; markMoved(); }
 		Vec2i getPos() const { return { box.x, box.y }; }
 
 		void setSize(Vec2i vec) { setSize(vec.x, vec.y); }
-		virtual void setSize(int x, int y) { box.z = x; box.w = y; }
+		virtual void setSize(int x, int y) { box.z = x; box.w = y; markMoved(); }
 		Vec2i getSize() const { return { box.z, box.w }; }
 
 		void setBackColor(ui8 r, ui8 g, ui8 b, ui8 a = 255) { setBackColor({ r,g,b,a }); }
 		Pixel getBackColor() const { return backColorMemory; }
-		virtual void setBackColor(Pixel color) { backColor = color; backColorMemory = color; }
+		virtual void setBackColor(Pixel color) { backColor = color; backColorMemory = color; markDirty(); }
 
 		void setBorderColor(ui8 r, ui8 g, ui8 b, ui8 a = 255) { setBorderColor({ r,g,b,a }); }
 		Pixel getBorderColor() const { return borderColorMemory; }
-		virtual void setBorderColor(Pixel color) { borderColor = color; borderColorMemory = color; }
+		virtual void setBorderColor(Pixel color) { borderColor = color; borderColorMemory = color; markDirty(); }
 
 		void setBackDisplayColor(ui8 r, ui8 g, ui8 b, ui8 a = 255) { setBackDisplayColor({ r,g,b,a }); }
 		Pixel getBackDisplayColor() const { return backColor; }
-		virtual void setBackDisplayColor(Pixel color) { backColor = color; }
+		virtual void setBackDisplayColor(Pixel color) { backColor = color; markDirty(); }
 
 		void setBorderDisplayColor(ui8 r, ui8 g, ui8 b, ui8 a = 255) { setBorderDisplayColor({ r,g,b,a }); }
 		Pixel getBorderDisplayColor() const { return borderColor; }
-		virtual void setBorderDisplayColor(Pixel color) { borderColor = color; }
+		virtual void setBorderDisplayColor(Pixel color) { borderColor = color; markDirty(); }
 
-		void restoreBackDisplayColor() { backColor = backColorMemory; }
-		void restoreBorderDisplayColor() { borderColor = borderColorMemory; }
+		void restoreBackDisplayColor() { backColor = backColorMemory; markDirty(); }
+		void restoreBorderDisplayColor() { borderColor = borderColorMemory; markDirty(); }
+
+		/*true when back and border colors fully cover whatever is under the widget*/
+		bool isOpaque() const { return backColor.a == 255 && borderColor.a == 255; }
 
 		virtual bool ifOnOver(const MouseInf& info) {
 			over = (
@@ -76,6 +129,18 @@ namespace voi {
 			return over;
 		}
 
+		/*-------- retained mode events, dispatched by UITree --------*/
+
+		virtual void onMouseEnter(const MouseInf& info) { over = true; }
+		virtual void onMouseLeave(const MouseInf& info) { over = false; }
+		virtual void onMouseClick(MouseAccess key, bool state) {}
+		virtual void onKeyDown(KeyAccess key) {}
+
+		/*called every Render while animated, time in seconds since the engine started*/
+		virtual void Animate(float totalTime) {}
+
+		virtual ~Box() {}
+
 		virtual void Draw() {
 			engine->colorSet = backColor;
 			engine->FillRect(box.x, box.y, box.z, box.w);
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <functional>
+
 #include "InteractTextBox.h"
 
 namespace voi {
 	class Button : public InteractTextBox {
+		std::function<void()> clickAction;
+
 	public:
 
 		Button() {
@@ -18,6 +22,7 @@ namespace voi {
 
 					backColor = backClickColor;
 					borderColor = borderClickColor;
+					markDirty();
 			}
 			else {
 
@@ -25,6 +30,7 @@ namespace voi {
 					if (isClicked) {
 						backColor = backOverColor;
 						borderColor = borderOverColor;
+						markDirty();
 
 						action();
 					}
@@ -36,5 +42,12 @@ namespace voi {
 				isClicked = false;
 			}
 		}
+
+		/*action run on release when the button is owned by a UITree*/
+		void setOnClick(std::function<void()> action) { clickAction = action; }
+
+		virtual void onMouseClick(MouseAccess key, bool state) override {
+			onClick(state, [&]() { if (clickAction) clickAction(); });
+		}
 	};
 }
@@ -0,0 +1,1076 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+#include "utilDefs.h"
+
+/*---------------------------------------------------------------------------------------
+   CHIP8 machine without any windowing: memory, registers, timers and the fetch-decode-
+   execute cycle. The owner loads a ROM, feeds the keypad state, runs the CPU either by
+   cycle count or by elapsed time at the clock rate, then reads the screen back. Nothing
+   here touches the OS, so ROMs can run headless for tests and batch runs on any platform.
+
+   Besides plain CHIP8 it runs SUPER-CHIP (128x64, scrolling, 16x16 sprites, big font)
+   and XO-CHIP (64 KiB of memory, 2 bitplanes, audio pattern). The screen is a bitboard
+   of 2 ui64 per row per plane at every resolution, low resolution only uses the first
+   word of its 32 rows, so sprites and scrolls stay whole-word operations. Each mode
+   keeps the quirks of its set, picked when an instruction is decoded: SUPER-CHIP shifts
+   VX in place and jumps with BXNN, XO-CHIP moves I past the registers FX55/FX65 touch.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Core {
+public:
+	enum : ui16 {
+		MEMORY_SIZE = 4096,
+		PROGRAM_START = 0x200,
+		FONT_ADDRESS = 0x050,
+		BIG_FONT_ADDRESS = 0x0A0,
+		SCREEN_WIDTH = 64,
+		SCREEN_HEIGHT = 32,
+		TIMER_RATE = 60
+	};
+
+	enum : ui32 {
+		XO_MEMORY_SIZE = 0x10000,
+		MAX_WIDTH = 128,
+		MAX_HEIGHT = 64,
+		ROW_WORDS = 2,		// ui64 per screen row, at every resolution
+		PLANES = 2
+	};
+
+	enum : ui8 { MODE_CHIP8, MODE_SCHIP, MODE_XOCHIP };
+
+	enum : ui32 { DEFAULT_CLOCK = 1000 };
+	enum : ui64 { DEFAULT_SEED = 0x9E3779B97F4A7C15ull };
+
+	/*-----------------------------------------------------------------------------------
+	   save state blob, fixed layout so consecutive ones can be diffed byte to byte:
+	   header, registers, flag registers, audio pattern, stack, screen, then the memory
+	   of the mode. The clock rate, the seed and the keypad belong to the owner and are
+	   not in it
+	-----------------------------------------------------------------------------------*/
+	enum : ui32 {
+		STATE_MAGIC = 0x32533843,	// "C8S2"
+		STATE_HEADER = 40,
+		STATE_FIXED = STATE_HEADER + 16 + 16 + 16 + 256 * 2 + PLANES * MAX_HEIGHT * ROW_WORDS * 8
+	};
+
+	/*-----------------------------------------------------------------------------------
+	   alternative execution engine, like the JIT in Chip8Jit.h. It runs whole batches
+	   in place of the interpreter and hears about every write into memory and every
+	   reload, so it can drop the translations they make stale
+	-----------------------------------------------------------------------------------*/
+	struct Accelerator {
+		virtual ~Accelerator() {}
+		virtual void Execute(Chip8Core& core, ui64 count) = 0;
+		virtual void CodeWritten(ui16 addr) = 0;
+		virtual void CodeReset() = 0;
+	};
+
+private:
+	/*-----------------------------------------------------------------------------------
+	   the word at every address decoded once into its handler and operand fields, pc
+	   indexes it directly. Entries start as Undecoded, which decodes on first run, and
+	   go back to it when a write lands on either of their 2 bytes
+	-----------------------------------------------------------------------------------*/
+	struct Decoded;
+	typedef void (*Handler)(Chip8Core& c, const Decoded& d);
+
+	struct Decoded {
+		Handler op;
+		ui16 nnn;
+		ui8 x, y, n, nn;
+	};
+
+	//the CPU is either running or parked by FX0A or by 00FD
+	enum : ui8 { WAIT_NONE, WAIT_KEY, WAIT_HALT };
+
+	std::vector<Decoded> code;		// one per address of the mode
+
+	std::array<ui8, XO_MEMORY_SIZE> mem = { 0 };
+	std::array<ui8, 16> reg = { 0 };
+	std::array<ui8, 16> flags = { 0 };		// FX75 / FX85 storage
+	std::array<ui8, 16> pattern = { 0 };	// XO-CHIP audio, 1 bit samples
+	std::array<ui16, 256> stack = { 0 };
+	std::array<ui64, PLANES * MAX_HEIGHT * ROW_WORDS> screen = { 0 };	// bit 63 of a row's first word is its leftmost pixel
+
+	ui8 dt = 0;
+	ui8 sp = 0;
+	ui8 st = 0;
+	ui16 I = 0;
+	ui16 pc = PROGRAM_START;
+	ui16 fntAddr = FONT_ADDRESS;
+
+	ui8 mode = MODE_CHIP8;
+	ui16 addrMask = MEMORY_SIZE - 1;
+	bool hires = false;
+	ui8 planes = 1;			// bitplanes drawing, clearing and scrolling act on
+	ui8 pitch = 64;
+
+	ui16 keys = 0;		// bit k set while key k is down
+	ui64 cycles = 0;
+
+	//FX0A parks the CPU until a key goes down, 00FD for good, the cycles still pass but nothing runs
+	ui8 wait = WAIT_NONE;
+	ui8 waitReg = 0;
+
+	ui64 seed = DEFAULT_SEED;	// CXNN draws from a xorshift seeded with it on every reset
+	ui64 random = DEFAULT_SEED;
+
+	ui32 clockRate = DEFAULT_CLOCK;	// cycles per emulated second
+	ui32 timerPhase = 0;			// TIMER_RATE per cycle, the timers tick each clockRate
+	double owed = 0.0;				// fraction of a cycle RunFor still owes
+	bool screenChanged = true;
+
+	Accelerator* accelerator = nullptr;
+
+	friend class Chip8Jit;
+
+public:
+	Chip8Core() { Reset(); }
+
+	/*clears the machine and puts the fonts back, memory from PROGRAM_START is left empty. The mode, clock rate and seed are kept*/
+	void Reset() {
+		mem = { 0 };
+		reg = { 0 };
+		flags = { 0 };
+		pattern = { 0 };
+		stack = { 0 };
+		screen = { 0 };
+		dt = sp = st = 0;
+		I = 0;
+		pc = PROGRAM_START;
+		addrMask = ui16(MemorySize() - 1);
+		hires = false;
+		planes = 1;
+		pitch = 64;
+		keys = 0;
+		cycles = 0;
+		wait = WAIT_NONE;
+		waitReg = 0;
+		timerPhase = 0;
+		owed = 0.0;
+		screenChanged = true;
+		random = seed;
+
+		static const ui8 fontData[16 * 5] = {
+			0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+			0x20, 0x60, 0x20, 0x20, 0x70, // 1
+			0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+			0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+			0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+			0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+			0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+			0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+			0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+			0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+			0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+			0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+			0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+			0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+			0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+			0xF0, 0x80, 0xF0, 0x80, 0x80, // F
+		};
+
+		//SUPER-CHIP 8x10 digits for FX30, XO-CHIP adds A to F
+		static const ui8 bigFontData[16 * 10] = {
+			0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+			0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+			0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+			0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+			0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+			0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+			0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+			0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+			0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+			0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+			0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+			0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+			0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+		};
+
+		memcpy(&mem[fntAddr], fontData, sizeof(fontData));
+		memcpy(&mem[BIG_FONT_ADDRESS], bigFontData, sizeof(bigFontData));
+		invalidateCode();
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   instruction set and memory size, the machine is reset to apply it so it goes
+	   before LoadRom
+	-----------------------------------------------------------------------------------*/
+	void SetMode(ui8 m) {
+		mode = m <= MODE_XOCHIP ? m : ui8(MODE_CHIP8);
+		Reset();
+	}
+	ui8 Mode() const { return mode; }
+	ui32 MemorySize() const { return mode == MODE_XOCHIP ? XO_MEMORY_SIZE : MEMORY_SIZE; }
+
+	/*resets the machine and copies the ROM at PROGRAM_START, false if it does not fit*/
+	bool LoadRom(const ui8* data, size_t size) {
+		if (size > MemorySize() - PROGRAM_START) return false;
+
+		Reset();
+		memcpy(&mem[PROGRAM_START], data, size);
+		invalidateCode();
+		return true;
+	}
+
+	bool LoadRom(const char* path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return false;
+
+		std::vector<ui8> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		return LoadRom(data.data(), data.size());
+	}
+
+	/*---------- execution ------------*/
+
+	/*one cycle, straight from the decoded word at pc, or an idle one while the CPU waits*/
+	void Step() {
+		if (wait) cycles++;
+		else execute();
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   runs count cycles back to back, the timers tick every clockRate / 60 of them so
+	   they keep 60 Hz of emulated time whatever the clock rate is
+	-----------------------------------------------------------------------------------*/
+	void Run(ui64 count) {
+		while (count) {
+			//cycles left before the next timer tick
+			const ui64 untilTick = (clockRate - timerPhase + TIMER_RATE - 1) / TIMER_RATE;
+			const ui64 batch = count < untilTick ? count : untilTick;
+
+			if (wait) cycles += batch;
+			else if (accelerator) accelerator->Execute(*this, batch);
+			else {
+				//no instruction changes the table or the mask, only SetMode and LoadState do
+				const Decoded* table = code.data();
+				const ui16 mask = addrMask;
+
+				//a wait started inside the batch idles the rest of it
+				const ui64 end = cycles + batch;
+				while (cycles < end && !wait) {
+					const Decoded& d = table[pc];
+					pc = (pc + 2) & mask;
+					d.op(*this, d);
+					cycles++;
+				}
+				cycles = end;
+			}
+
+			count -= batch;
+			timerPhase += ui32(batch * TIMER_RATE);
+			if (timerPhase >= clockRate) {
+				timerPhase -= clockRate;
+				TickTimers();
+			}
+		}
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   runs the cycles owed for seconds of real time at the clock rate, the fraction of a
+	   cycle left over is carried to the next call so the speed is exact at any frame
+	   rate. Longer gaps than maxSeconds, like a stall in the debugger, are dropped
+	   instead of caught up. Returns the cycles it ran
+	-----------------------------------------------------------------------------------*/
+	ui64 RunFor(double seconds, double maxSeconds = 0.25) {
+		if (seconds > maxSeconds) seconds = maxSeconds;
+		if (seconds <= 0.0) return 0;
+
+		owed += seconds * clockRate;
+		const ui64 count = (ui64)owed;
+		owed -= (double)count;
+
+		Run(count);
+		return count;
+	}
+
+	/*nullptr goes back to the interpreter, the accelerator has to outlive its use*/
+	void SetAccelerator(Accelerator* a) { accelerator = a; }
+	Accelerator* GetAccelerator() const { return accelerator; }
+
+	/*the delay and sound timers count down at 60 Hz, Run already ticks them*/
+	void TickTimers() {
+		dt -= (dt > 0 ? 1 : 0);
+		st -= (st > 0 ? 1 : 0);
+	}
+
+	void SetClockRate(ui32 hz) { clockRate = hz ? hz : 1; timerPhase = 0; }
+	ui32 ClockRate() const { return clockRate; }
+
+	/*CXNN sequence of every reset from now on, and of the current run from here*/
+	void SetSeed(ui64 s) { seed = random = s ? s : ui64(DEFAULT_SEED); }
+	ui64 Seed() const { return seed; }
+
+	/*true once after the screen changed, so the owner only redraws when it has to*/
+	bool TakeScreenChanged() {
+		const bool changed = screenChanged;
+		screenChanged = false;
+		return changed;
+	}
+
+	/*---------- save states ------------*/
+
+	static ui32 StateSize(ui8 m) { return STATE_FIXED + (m == MODE_XOCHIP ? XO_MEMORY_SIZE : MEMORY_SIZE); }
+	ui32 StateSize() const { return StateSize(mode); }
+
+	/*writes StateSize() bytes into blob*/
+	void SaveState(ui8* blob) const {
+		ui8* p = blob;
+		auto put = [&p](const void* src, size_t size) { memcpy(p, src, size); p += size; };
+
+		const ui32 magic = STATE_MAGIC;
+		const ui8 timers[4] = { sp, dt, st, ui8(wait == WAIT_KEY ? 0x80 | waitReg : wait == WAIT_HALT ? 0x40 : 0) };
+		const ui8 display[8] = { mode, ui8(hires), planes, pitch, 0, 0, 0, 0 };
+		put(&magic, 4);
+		put(&pc, 2);
+		put(&I, 2);
+		put(timers, 4);
+		put(&timerPhase, 4);
+		put(&cycles, 8);
+		put(&random, 8);
+		put(display, 8);
+		put(reg.data(), sizeof(reg));
+		put(flags.data(), sizeof(flags));
+		put(pattern.data(), sizeof(pattern));
+		put(stack.data(), sizeof(stack));
+		put(screen.data(), sizeof(screen));
+		put(mem.data(), MemorySize());
+	}
+
+	std::vector<ui8> SaveState() const {
+		std::vector<ui8> blob(StateSize());
+		SaveState(blob.data());
+		return blob;
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   restores a blob from SaveState, mode included, false and the machine untouched if
+	   it is not one. All decoded code is dropped, since memory can be anything afterwards
+	-----------------------------------------------------------------------------------*/
+	bool LoadState(const ui8* blob, size_t size) {
+		ui32 magic = 0;
+		if (size < STATE_HEADER) return false;
+		memcpy(&magic, blob, 4);
+		if (magic != STATE_MAGIC || blob[32] > MODE_XOCHIP || size != StateSize(blob[32])) return false;
+
+		const ui8* p = blob + 4;
+		auto get = [&p](void* dst, size_t size) { memcpy(dst, p, size); p += size; };
+
+		ui8 timers[4], display[8];
+		get(&pc, 2);
+		get(&I, 2);
+		get(timers, 4);
+		get(&timerPhase, 4);
+		get(&cycles, 8);
+		get(&random, 8);
+		get(display, 8);
+
+		mode = display[0];
+		hires = display[1] != 0 && mode != MODE_CHIP8;
+		planes = display[2] & 3;
+		pitch = display[3];
+		addrMask = ui16(MemorySize() - 1);
+
+		get(reg.data(), sizeof(reg));
+		get(flags.data(), sizeof(flags));
+		get(pattern.data(), sizeof(pattern));
+		get(stack.data(), sizeof(stack));
+		get(screen.data(), sizeof(screen));
+		get(mem.data(), MemorySize());
+		if (mode != MODE_XOCHIP) memset(&mem[MEMORY_SIZE], 0, XO_MEMORY_SIZE - MEMORY_SIZE);
+
+		sp = timers[0];
+		dt = timers[1];
+		st = timers[2];
+		wait = (timers[3] & 0x80) ? WAIT_KEY : (timers[3] & 0x40) ? WAIT_HALT : WAIT_NONE;
+		waitReg = timers[3] & 0x0F;
+		pc &= addrMask;
+		I &= addrMask;
+		if (timerPhase >= clockRate) timerPhase = 0;
+		if (!random) random = seed;
+		owed = 0.0;
+		screenChanged = true;
+		invalidateCode();
+		return true;
+	}
+
+	bool LoadState(const std::vector<ui8>& blob) { return LoadState(blob.data(), blob.size()); }
+
+	/*---------- keypad, keys 0 to F ------------*/
+
+	void SetKey(ui8 k, bool pressed) {
+		if (pressed) keys |= ui16(1 << (k & 0xF));
+		else keys &= ui16(~(1 << (k & 0xF)));
+		if (wait == WAIT_KEY) keyWait();
+	}
+	void SetKeys(ui16 mask) {
+		keys = mask;
+		if (wait == WAIT_KEY) keyWait();
+	}
+	ui16 Keys() const { return keys; }
+
+	/*true while FX0A holds the CPU, Run only lets time pass until a key goes down*/
+	bool WaitingForKey() const { return wait == WAIT_KEY; }
+
+	/*00FD ran, nothing but a reset or a load brings the CPU back*/
+	bool Halted() const { return wait == WAIT_HALT; }
+
+	/*---------- state ------------*/
+
+	bool Hires() const { return hires; }
+	int ScreenWidth() const { return hires ? MAX_WIDTH : SCREEN_WIDTH; }
+	int ScreenHeight() const { return hires ? MAX_HEIGHT : SCREEN_HEIGHT; }
+
+	/*ScreenHeight() rows of ROW_WORDS each, in low resolution only the first word of a row is used*/
+	const ui64* Plane(ui8 p = 0) const { return &screen[(p & 1) * MAX_HEIGHT * ROW_WORDS]; }
+	bool PixelAt(int x, int y, ui8 p = 0) const { return (Plane(p)[y * ROW_WORDS + (x >> 6)] >> (63 - (x & 63))) & 1; }
+
+	const std::array<ui8, XO_MEMORY_SIZE>& Memory() const { return mem; }
+	ui8 V(ui8 x) const { return reg[x & 0xF]; }
+	ui16 PC() const { return pc; }
+	ui16 Index() const { return I; }
+	ui8 DelayTimer() const { return dt; }
+	ui8 SoundTimer() const { return st; }
+	bool SoundOn() const { return st > 0; }
+	ui64 Cycles() const { return cycles; }
+
+	/*XO-CHIP sound: 128 one bit samples played in a loop while the sound timer runs*/
+	const std::array<ui8, 16>& AudioPattern() const { return pattern; }
+	ui8 AudioPitch() const { return pitch; }
+	f64 AudioRate() const { return 4000.0 * pow(2.0, (pitch - 64) / 48.0); }
+
+private:
+
+// ############################################################
+// ############################################################
+// ##                                                        ##
+// ##              CPU fetch-decode-execute cycle            ##
+// ##                     IMPLEMMENTATION                    ##
+// ##                                                        ##
+// ############################################################
+// ############################################################
+
+	// stack
+
+	void stackPush(ui16 addr) {
+		stack[sp++] = addr;
+	}
+
+	ui16 stackPop() {
+		return stack[--sp];
+	}
+
+	void execute() {
+		const Decoded& d = code[pc];
+		pc = (pc + 2) & addrMask;
+		d.op(*this, d);
+		cycles++;
+	}
+
+	//skips the next instruction, in XO-CHIP that is 4 bytes when it is F000 NNNN
+	void skip() {
+		const ui16 size = (mode == MODE_XOCHIP && fetch(pc) == 0xF000) ? 4 : 2;
+		pc = (pc + size) & addrMask;
+	}
+
+	//xorshift64*, every instance has its own sequence so runs repeat exactly
+	ui8 nextRandom() {
+		random ^= random >> 12;
+		random ^= random << 25;
+		random ^= random >> 27;
+		return ui8((random * 0x2545F4914F6CDD1Dull) >> 56);
+	}
+
+	//input implementation
+
+	bool chip8Pressed(ui8 k) {
+		return (keys >> (k & 0xF)) & 1;
+	}
+
+	//the lowest key down ends the FX0A wait, pc already is past it
+	void keyWait() {
+		for (ui8 k = 0; k < 16; k++) {
+			if (chip8Pressed(k)) {
+				reg[waitReg] = k;
+				wait = WAIT_NONE;
+				return;
+			}
+		}
+	}
+
+	// display
+
+	ui64* plane(ui8 p) { return &screen[p * MAX_HEIGHT * ROW_WORDS]; }
+
+	/*-----------------------------------------------------------------------------------
+	   any sprite on any plane: 8 pixels wide and n rows, or 16x16 for n = 0. Each row
+	   is put left aligned in a 128 bit row and moved right to x, what falls past the
+	   right or bottom edge is clipped. XO-CHIP takes the data of every selected plane
+	   one after the other
+	-----------------------------------------------------------------------------------*/
+	void drawSprite(ui8 x, ui8 y, ui8 n) {
+		const int width = ScreenWidth(), height = ScreenHeight();
+		const int px = reg[x] & (width - 1), py = reg[y] & (height - 1);
+		const bool wide = n == 0;
+		const int rows = wide ? 16 : n, bits = wide ? 16 : 8;
+
+		ui16 addr = I;
+		ui64 hit = 0, drawn = 0;
+		for (ui8 p = 0; p < PLANES; p++) {
+			if (!(planes & (1 << p))) continue;
+			ui64* rowsOf = plane(p);
+
+			for (int i = 0; i < rows; i++) {
+				ui64 spr = mem[addr & addrMask];
+				addr++;
+				if (wide) {
+					spr = (spr << 8) | mem[addr & addrMask];
+					addr++;
+				}
+				if (py + i >= height) continue;
+
+				ui64 hi = spr << (64 - bits), lo = 0;
+				if (px >= 64) {
+					lo = hi >> (px - 64);
+					hi = 0;
+				}
+				else if (px) {
+					lo = hi << (64 - px);
+					hi >>= px;
+				}
+				if (!hires) lo = 0;
+
+				ui64* row = rowsOf + (py + i) * ROW_WORDS;
+				hit |= (row[0] & hi) | (row[1] & lo);
+				row[0] ^= hi;
+				row[1] ^= lo;
+				drawn |= hi | lo;
+			}
+		}
+
+		reg[0xF] = hit != 0;
+		if (drawn) screenChanged = true;
+	}
+
+	/*whole rows of the selected planes, down for n > 0 and up for n < 0*/
+	void scrollRows(int n) {
+		const int height = ScreenHeight();
+		const int shift = n < 0 ? -n : n;
+		const int moved = shift < height ? height - shift : 0;
+
+		for (ui8 p = 0; p < PLANES; p++) {
+			if (!(planes & (1 << p))) continue;
+			ui64* rows = plane(p);
+
+			if (n > 0) {
+				memmove(rows + (height - moved) * ROW_WORDS, rows, moved * ROW_WORDS * sizeof(ui64));
+				memset(rows, 0, (height - moved) * ROW_WORDS * sizeof(ui64));
+			}
+			else {
+				memmove(rows, rows + (height - moved) * ROW_WORDS, moved * ROW_WORDS * sizeof(ui64));
+				memset(rows + moved * ROW_WORDS, 0, (height - moved) * ROW_WORDS * sizeof(ui64));
+			}
+		}
+		screenChanged = true;
+	}
+
+	/*4 pixels sideways, a shift of each row's words with the carry between them*/
+	void scrollColumns(bool left) {
+		const int height = ScreenHeight();
+
+		for (ui8 p = 0; p < PLANES; p++) {
+			if (!(planes & (1 << p))) continue;
+			ui64* rows = plane(p);
+
+			for (int r = 0; r < height; r++) {
+				ui64* row = rows + r * ROW_WORDS;
+				if (!hires) row[0] = left ? row[0] << 4 : row[0] >> 4;
+				else if (left) {
+					row[0] = (row[0] << 4) | (row[1] >> 60);
+					row[1] <<= 4;
+				}
+				else {
+					row[1] = (row[1] >> 4) | (row[0] << 60);
+					row[0] >>= 4;
+				}
+			}
+		}
+		screenChanged = true;
+	}
+
+	/*switching resolution starts from a blank screen on every plane*/
+	void setResolution(bool high) {
+		hires = high;
+		screen = { 0 };
+		screenChanged = true;
+	}
+
+	// decoding
+
+	ui16 fetch(ui16 addr) const {
+		return (ui16(mem[addr & addrMask]) << 8) | ui16(mem[(addr + 1) & addrMask]);
+	}
+
+	//every code write goes through here, so the decoded words touching addr are dropped
+	void write(ui16 addr, ui8 value) {
+		addr &= addrMask;
+		mem[addr] = value;
+		code[addr].op = &Chip8Core::Undecoded;
+		code[(addr - 1) & addrMask].op = &Chip8Core::Undecoded;
+		if (accelerator) accelerator->CodeWritten(addr);
+	}
+
+	void invalidateCode() {
+		code.resize(MemorySize());
+		for (Decoded& d : code) d.op = &Chip8Core::Undecoded;
+		if (accelerator) accelerator->CodeReset();
+	}
+
+	/*first run of an address, decodes the word there and runs it*/
+	static void Undecoded(Chip8Core& c, const Decoded& d) {
+		const ui16 addr = ui16(&d - c.code.data());
+		c.code[addr] = decode(c.fetch(addr), c.mode);
+		c.code[addr].op(c, c.code[addr]);
+	}
+
+	static Decoded decode(ui16 opCode, ui8 mode) {
+		Decoded d;
+		d.nnn = opCode & 0x0FFF;
+		d.x = ui8((opCode & 0x0F00) >> 8);
+		d.y = ui8((opCode & 0x00F0) >> 4);
+		d.n = ui8(opCode & 0x000F);
+		d.nn = ui8(opCode & 0x00FF);
+		d.op = [](Chip8Core&, const Decoded&) {};
+
+		//instructions of the extended sets only decode in their modes, plain CHIP8 keeps its meaning for them
+		const bool super = mode != MODE_CHIP8;
+		const bool xo = mode == MODE_XOCHIP;
+
+		//SUPER-CHIP shifts VX in place and jumps to XNN + VX, the others shift VY into VX and jump to NNN + V0
+		const bool schip = mode == MODE_SCHIP;
+
+		switch ((opCode & 0xF000)) {
+		case 0x0000:
+			switch (opCode) {
+			case 0x00E0:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._00E0(); };
+				break;
+			case 0x00EE:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._00EE(); };
+				break;
+			default:
+				if (super && (opCode & 0xFFF0) == 0x00C0)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00CN(d.n); };
+				else if (xo && (opCode & 0xFFF0) == 0x00D0)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00DN(d.n); };
+				else if (super && opCode == 0x00FB)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00FB(); };
+				else if (super && opCode == 0x00FC)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00FC(); };
+				else if (super && opCode == 0x00FD)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00FD(); };
+				else if (super && opCode == 0x00FE)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00FE(); };
+				else if (super && opCode == 0x00FF)
+					d.op = [](Chip8Core& c, const Decoded& d) { c._00FF(); };
+				else
+					d.op = [](Chip8Core& c, const Decoded& d) { c._0NNN(d.nnn); };
+			}
+			break;
+		case 0x1000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._1NNN(d.nnn); };
+			break;
+		case 0x2000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._2NNN(d.nnn); };
+			break;
+		case 0x3000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._3XNN(d.x, d.nn); };
+			break;
+		case 0x4000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._4XNN(d.x, d.nn); };
+			break;
+		case 0x5000:
+			if (xo && d.n == 0x2)
+				d.op = [](Chip8Core& c, const Decoded& d) { c._5XY2(d.x, d.y); };
+			else if (xo && d.n == 0x3)
+				d.op = [](Chip8Core& c, const Decoded& d) { c._5XY3(d.x, d.y); };
+			else
+				d.op = [](Chip8Core& c, const Decoded& d) { c._5XY0(d.x, d.y); };
+			break;
+		case 0x6000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._6XNN(d.x, d.nn); };
+			break;
+		case 0x7000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._7XNN(d.x, d.nn); };
+			break;
+		case 0x8000:
+			switch (opCode & 0x000F) {
+			case 0x0:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY0(d.x, d.y); };
+				break;
+			case 0x1:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY1(d.x, d.y); };
+				break;
+			case 0x2:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY2(d.x, d.y); };
+				break;
+			case 0x3:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY3(d.x, d.y); };
+				break;
+			case 0x4:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY4(d.x, d.y); };
+				break;
+			case 0x5:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY5(d.x, d.y); };
+				break;
+			case 0x6:
+				if (schip) d.y = d.x;
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY6(d.x, d.y); };
+				break;
+			case 0x7:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XY7(d.x, d.y); };
+				break;
+			case 0xE:
+				if (schip) d.y = d.x;
+				d.op = [](Chip8Core& c, const Decoded& d) { c._8XYE(d.x, d.y); };
+				break;
+			}
+			break;
+		case 0x9000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._9XY0(d.x, d.y); };
+			break;
+		case 0xA000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._ANNN(d.nnn); };
+			break;
+		case 0xB000:
+			if (schip) d.op = [](Chip8Core& c, const Decoded& d) { c._BXNN(d.x, d.nnn); };
+			else d.op = [](Chip8Core& c, const Decoded& d) { c._BNNN(d.nnn); };
+			break;
+		case 0xC000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._CXNN(d.x, d.nn); };
+			break;
+		case 0xD000:
+			d.op = [](Chip8Core& c, const Decoded& d) { c._DXYN(d.x, d.y, d.n); };
+			break;
+		case 0xE000:
+			switch (ui8(opCode & 0x00FF)) {
+			case 0x9E:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._EX9E(d.x); };
+				break;
+			case 0xA1:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._EXA1(d.x); };
+				break;
+			}
+			break;
+		case 0xF000:
+			if (xo && opCode == 0xF000) {
+				d.op = [](Chip8Core& c, const Decoded& d) { c._F000(); };
+				break;
+			}
+			if (xo && opCode == 0xF002) {
+				d.op = [](Chip8Core& c, const Decoded& d) { c._F002(); };
+				break;
+			}
+
+			switch (ui8(opCode & 0x00FF)) {
+			case 0x01:
+				if (xo) d.op = [](Chip8Core& c, const Decoded& d) { c._FN01(d.x); };
+				break;
+			case 0x07:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX07(d.x); };
+				break;
+			case 0x0A:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX0A(d.x); };
+				break;
+			case 0x15:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX15(d.x); };
+				break;
+			case 0x18:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX18(d.x); };
+				break;
+			case 0x1E:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX1E(d.x); };
+				break;
+			case 0x29:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX29(d.x); };
+				break;
+			case 0x30:
+				if (super) d.op = [](Chip8Core& c, const Decoded& d) { c._FX30(d.x); };
+				break;
+			case 0x33:
+				d.op = [](Chip8Core& c, const Decoded& d) { c._FX33(d.x); };
+				break;
+			case 0x3A:
+				if (xo) d.op = [](Chip8Core& c, const Decoded& d) { c._FX3A(d.x); };
+				break;
+			//XO-CHIP leaves I past the last register it stored or loaded
+			case 0x55:
+				if (xo) d.op = [](Chip8Core& c, const Decoded& d) { c._FX55(d.x); c.advanceIndex(d.x); };
+				else d.op = [](Chip8Core& c, const Decoded& d) { c._FX55(d.x); };
+				break;
+			case 0x65:
+				if (xo) d.op = [](Chip8Core& c, const Decoded& d) { c._FX65(d.x); c.advanceIndex(d.x); };
+				else d.op = [](Chip8Core& c, const Decoded& d) { c._FX65(d.x); };
+				break;
+			case 0x75:
+				if (super) d.op = [](Chip8Core& c, const Decoded& d) { c._FX75(d.x); };
+				break;
+			case 0x85:
+				if (super) d.op = [](Chip8Core& c, const Decoded& d) { c._FX85(d.x); };
+				break;
+			}
+			break;
+		}
+
+		return d;
+	}
+
+// ############################################################
+// ############################################################
+// ##                                                        ##
+// ##                   OPCODES INSTRUCTIONS                 ##
+// ##                     IMPLEMMENTATION                    ##
+// ##                                                        ##
+// ############################################################
+// ############################################################
+
+	void _0NNN(ui16 nnn) {
+		stackPush(pc);
+		pc = nnn;
+	}
+
+	void _00E0() {
+		for (ui8 p = 0; p < PLANES; p++) {
+			if (planes & (1 << p)) memset(plane(p), 0, MAX_HEIGHT * ROW_WORDS * sizeof(ui64));
+		}
+		screenChanged = true;
+	}
+
+	void _00EE() {
+		pc = stackPop();
+	}
+
+	void _00CN(ui8 n) {
+		scrollRows(n);
+	}
+
+	void _00DN(ui8 n) {
+		scrollRows(-n);
+	}
+
+	void _00FB() {
+		scrollColumns(false);
+	}
+
+	void _00FC() {
+		scrollColumns(true);
+	}
+
+	void _00FD() {
+		wait = WAIT_HALT;
+	}
+
+	void _00FE() {
+		setResolution(false);
+	}
+
+	void _00FF() {
+		setResolution(true);
+	}
+
+	void _1NNN(ui16 nnn) {
+		pc = nnn;
+	}
+
+	void _2NNN(ui16 nnn) {
+		stackPush(pc);
+		pc = nnn;
+	}
+
+	void _3XNN(ui8 x, ui8 nn) {
+		if (reg[x] == nn) skip();
+	}
+
+	void _4XNN(ui8 x, ui8 nn) {
+		if (reg[x] != nn) skip();
+	}
+
+	void _5XY0(ui8 x, ui8 y) {
+		if (reg[x] == reg[y]) skip();
+	}
+
+	//5XY2 and 5XY3 store and load vx to vy in either order, I stays where it is
+	void _5XY2(ui8 x, ui8 y) {
+		const int step = x <= y ? 1 : -1;
+		for (int r = x, of = 0;; r += step, of++) {
+			write(ui16(I + of), reg[r]);
+			if (r == y) break;
+		}
+	}
+
+	void _5XY3(ui8 x, ui8 y) {
+		const int step = x <= y ? 1 : -1;
+		for (int r = x, of = 0;; r += step, of++) {
+			reg[r] = mem[(I + of) & addrMask];
+			if (r == y) break;
+		}
+	}
+
+	void _6XNN(ui8 x, ui8 nn) {
+		reg[x] = nn;
+	}
+
+	void _7XNN(ui8 x, ui8 nn) {
+		reg[x] += nn;
+	}
+
+	void _8XY0(ui8 x, ui8 y) {
+		reg[x] = reg[y];
+	}
+	void _8XY1(ui8 x, ui8 y) {
+		reg[x] |= reg[y];
+	}
+	void _8XY2(ui8 x, ui8 y) {
+		reg[x] &= reg[y];
+	}
+	void _8XY3(ui8 x, ui8 y) {
+		reg[x] ^= reg[y];
+	}
+	//the arithmetic reads both operands before writing VX, X or Y can be F or each other, VF is always the flag
+	void _8XY4(ui8 x, ui8 y) {
+		const ui16 sum = ui16(reg[x] + reg[y]);
+		reg[x] = ui8(sum);
+		reg[0xF] = ui8(sum >> 8);
+	}
+	void _8XY5(ui8 x, ui8 y) {
+		const ui8 xn = reg[x], yn = reg[y];
+		reg[x] = ui8(xn - yn);
+		reg[0xF] = (xn >= yn);
+	}
+	void _8XY6(ui8 x, ui8 y) {
+		//the source is read once, X can be Y
+		const ui8 yn = reg[y];
+		reg[x] = yn >> 1;
+		reg[0xF] = yn & 0x1;
+	}
+	void _8XY7(ui8 x, ui8 y) {
+		const ui8 xn = reg[x], yn = reg[y];
+		reg[x] = ui8(yn - xn);
+		reg[0xF] = (yn >= xn);
+	}
+	void _8XYE(ui8 x, ui8 y) {
+		const ui8 yn = reg[y];
+		reg[x] = ui8(yn << 1);
+		reg[0xF] = yn >> 7;
+	}
+	void _9XY0(ui8 x, ui8 y) {
+		if (reg[x] != reg[y]) skip();
+	}
+	void _ANNN(ui16 nnn) {
+		I = nnn;
+	}
+	void _BNNN(ui16 nnn) {
+		pc = ((nnn + reg[0]) & addrMask);
+	}
+	void _BXNN(ui8 x, ui16 xnn) {
+		pc = ((xnn + reg[x]) & addrMask);
+	}
+	void _CXNN(ui8 x, ui8 nn) {
+		reg[x] = nextRandom() & nn;
+	}
+	void _DXYN(ui8 x, ui8 y, ui8 n) {
+		if (hires || planes != 1 || (!n && mode != MODE_CHIP8)) {
+			drawSprite(x, y, n);
+			return;
+		}
+
+		//plain 8 pixel sprite on the low resolution plane, one word per row
+		const ui8 px = reg[x] & (SCREEN_WIDTH - 1);
+		const ui8 py = reg[y] & (SCREEN_HEIGHT - 1);
+		ui64 hit = 0, drawn = 0;
+
+		for (ui8 i = 0; i < n && py + i < SCREEN_HEIGHT; i++) {
+			const ui64 spr = (ui64(mem[(I + i) & addrMask]) << 56) >> px;
+			ui64& row = screen[(py + i) * ROW_WORDS];
+			hit |= row & spr;
+			row ^= spr;
+			drawn |= spr;
+		}
+
+		reg[0xF] = hit != 0;
+		if (drawn) screenChanged = true;
+	}
+	void _EX9E(ui8 x) {
+		if (chip8Pressed(reg[x])) skip();
+	}
+	void _EXA1(ui8 x) {
+		if (!chip8Pressed(reg[x])) skip();
+	}
+	//I = the 16 bit word after it, the instruction is 4 bytes long
+	void _F000() {
+		I = fetch(pc);
+		pc = (pc + 2) & addrMask;
+	}
+	void _F002() {
+		for (ui8 of = 0; of < 16; of++) pattern[of] = mem[(I + of) & addrMask];
+	}
+	void _FN01(ui8 n) {
+		planes = n & 3;
+	}
+	void _FX07(ui8 x) {
+		reg[x] = dt;
+	}
+	//no spinning, the CPU goes into the wait state and the next key down resumes it
+	void _FX0A(ui8 x) {
+		waitReg = x;
+		wait = WAIT_KEY;
+		keyWait();
+	}
+	void _FX15(ui8 x) {
+		dt = reg[x];
+	}
+	void _FX18(ui8 x) {
+		st = reg[x];
+	}
+	void _FX1E(ui8 x) {
+		I = ((I + reg[x]) & addrMask);
+	}
+	void _FX29(ui8 x) {
+		I = (fntAddr + (reg[x] * 5)) & addrMask;
+	}
+	void _FX30(ui8 x) {
+		I = BIG_FONT_ADDRESS + (reg[x] & 0xF) * 10;
+	}
+	void _FX33(ui8 x) {
+		ui8 xn = reg[x];
+		write(I, ui8(xn / 100));
+		write(I + 1, ui8((xn / 10) % 10));
+		write(I + 2, ui8(xn % 10));
+	}
+	void _FX3A(ui8 x) {
+		pitch = reg[x];
+	}
+	void _FX55(ui8 x) {
+		for (ui8 of = 0; of <= x; of++) write(I + of, reg[of]);
+	}
+	void _FX65(ui8 x) {
+		for (ui8 of = 0; of <= x; of++) reg[of] = mem[(I + of) & addrMask];
+	}
+	void advanceIndex(ui8 x) {
+		I = ui16((I + x + 1) & addrMask);
+	}
+	void _FX75(ui8 x) {
+		for (ui8 of = 0; of <= x; of++) flags[of] = reg[of];
+	}
+	void _FX85(ui8 x) {
+		for (ui8 of = 0; of <= x; of++) reg[of] = flags[of];
+	}
+};
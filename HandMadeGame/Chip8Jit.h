@@ -0,0 +1,548 @@
+#pragma once
+
+#if defined(_M_X64) || defined(__x86_64__)
+
+#include <vector>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "utilDefs.h"
+#include "Chip8Core.h"
+
+/*---------------------------------------------------------------------------------------
+   Basic block recompiler for Chip8Core, x86-64 only. Addresses the CPU reaches often
+   enough get their run of straight-line instructions translated into host code, up to
+   and including the jump or skip that ends it. Exits to known addresses are patched
+   into direct jumps to the next block, so hot loops run without coming back here.
+
+   Generated code keeps the core in r8 and the cycles left in r9 and only touches
+   scratch registers both calling conventions share. Each block checks it has budget for
+   all its instructions before running any, so batches end on the exact cycle.
+   DXYN, FX0A, CXNN, the 0NNN group but 00EE and the memory writes FX33/FX55 end a
+   block and run in the interpreter, so do all the SUPER-CHIP additions. The shifts and
+   BNNN follow the SUPER-CHIP quirks in that mode. Writes to
+   memory drop every block covering the written byte. XO-CHIP is left to the
+   interpreter.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Jit : public Chip8Core::Accelerator {
+	enum : ui32 {
+		CACHE_SIZE = 1 << 20,
+		HOT_THRESHOLD = 8,		// visits before an address is compiled
+		MAX_INSTRUCTIONS = 64,
+		MAX_INSTRUCTION_BYTES = 576,	// FX65 loading all 16 registers is the longest, 16 x 34 bytes
+		ADDRESSES = Chip8Core::MEMORY_SIZE
+	};
+
+	typedef i64(*Enter)(Chip8Core* core, i64 budget, const ui8* block);
+
+	struct Entry {
+		const ui8* block = nullptr;
+		ui16 end = 0;			// first address past the block bytes
+		ui16 heat = 0;
+		bool uncompilable = false;
+		std::vector<ui8*> incoming;	// rel32 fields jumping into this block
+	};
+
+	Chip8Core& core;
+
+	ui8* cache = nullptr;
+	ui8* cursor = nullptr;
+	ui8* exitStub = nullptr;
+	Enter enter = nullptr;
+
+	Entry entries[ADDRESSES];
+	std::vector<ui8*> waiting[ADDRESSES];	// rel32 fields that will jump to this address once it compiles
+	std::vector<ui16> live;					// addresses with a block
+	ui16 covered[ADDRESSES] = {};			// live blocks over each byte
+
+	//field offsets inside the core, for [r8 + disp32] operands
+	i32 regOff, memOff, stackOff, pcOff, iOff, spOff, dtOff, stOff, keysOff;
+
+	ui64 compiledBlocks = 0;
+	ui64 flushes = 0;
+
+public:
+	Chip8Jit(Chip8Core& coreParam) : core(coreParam) {
+		const ui8* base = (const ui8*)&core;
+		regOff = i32((const ui8*)core.reg.data() - base);
+		memOff = i32((const ui8*)core.mem.data() - base);
+		stackOff = i32((const ui8*)core.stack.data() - base);
+		pcOff = i32((const ui8*)&core.pc - base);
+		iOff = i32((const ui8*)&core.I - base);
+		spOff = i32((const ui8*)&core.sp - base);
+		dtOff = i32((const ui8*)&core.dt - base);
+		stOff = i32((const ui8*)&core.st - base);
+		keysOff = i32((const ui8*)&core.keys - base);
+
+#ifdef _WIN32
+		cache = (ui8*)VirtualAlloc(NULL, CACHE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+		void* memory = mmap(nullptr, CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		cache = memory == MAP_FAILED ? nullptr : (ui8*)memory;
+#endif
+		//without a cache the core keeps interpreting
+		if (!cache) return;
+
+		Flush();
+		core.SetAccelerator(this);
+	}
+
+	Chip8Jit(const Chip8Jit& other) = delete;
+	void operator = (const Chip8Jit& other) = delete;
+
+	~Chip8Jit() {
+		if (core.GetAccelerator() == this) core.SetAccelerator(nullptr);
+		if (!cache) return;
+#ifdef _WIN32
+		VirtualFree(cache, 0, MEM_RELEASE);
+#else
+		munmap(cache, CACHE_SIZE);
+#endif
+	}
+
+	bool active() const { return cache != nullptr; }
+	ui64 blocksCompiled() const { return compiledBlocks; }
+	ui64 cacheFlushes() const { return flushes; }
+
+	/*---------- Accelerator ------------*/
+
+	void Execute(Chip8Core& c, ui64 count) override {
+		i64 budget = (i64)count;
+
+		//XO-CHIP has 64 KiB of code and longer instructions, it stays interpreted
+		if (c.mode == Chip8Core::MODE_XOCHIP) {
+			while (budget-- > 0) c.Step();
+			return;
+		}
+
+		while (budget > 0) {
+			//FX0A or 00FD went into their wait, the rest of the batch is idle
+			if (c.wait) {
+				c.cycles += ui64(budget);
+				return;
+			}
+
+			Entry& e = entries[c.pc];
+
+			if (!e.block && !e.uncompilable && ++e.heat >= HOT_THRESHOLD) Compile(c.pc);
+
+			if (e.block) {
+				const i64 left = enter(&c, budget, e.block);
+				c.cycles += ui64(budget - left);
+
+				//not enough budget left for the whole block
+				if (left == budget) {
+					c.Step();
+					budget--;
+				}
+				else budget = left;
+			}
+			else {
+				c.Step();
+				budget--;
+			}
+		}
+	}
+
+	void CodeWritten(ui16 addr) override {
+		if (addr >= ADDRESSES || !covered[addr]) return;
+
+		for (size_t i = 0; i < live.size();) {
+			const ui16 start = live[i];
+			if (start <= addr && addr < entries[start].end) {
+				Invalidate(start);
+				live[i] = live.back();
+				live.pop_back();
+			}
+			else i++;
+		}
+	}
+
+	void CodeReset() override {
+		if (cache) Flush();
+	}
+
+private:
+	/*---------- code cache ------------*/
+
+	/*drops every block, the stubs are rebuilt at the start of the cache*/
+	void Flush() {
+		for (Entry& e : entries) {
+			e.block = nullptr;
+			e.end = 0;
+			e.heat = 0;
+			e.uncompilable = false;
+			e.incoming.clear();
+		}
+		for (std::vector<ui8*>& w : waiting) w.clear();
+		live.clear();
+		memset(covered, 0, sizeof(covered));
+		flushes++;
+
+		cursor = cache;
+
+		//exit stub, the cycles left are the return value
+		exitStub = cursor;
+		Emit({ 0x4C, 0x89, 0xC8 });		// mov rax, r9
+		Emit({ 0xC3 });					// ret
+
+		//entry trampoline, core and budget go to r8 and r9, then jump to the block
+		enter = (Enter)cursor;
+#ifdef _WIN32
+		Emit({ 0x4C, 0x89, 0xC0 });		// mov rax, r8
+		Emit({ 0x49, 0x89, 0xC8 });		// mov r8, rcx
+		Emit({ 0x49, 0x89, 0xD1 });		// mov r9, rdx
+#else
+		Emit({ 0x48, 0x89, 0xD0 });		// mov rax, rdx
+		Emit({ 0x49, 0x89, 0xF8 });		// mov r8, rdi
+		Emit({ 0x49, 0x89, 0xF1 });		// mov r9, rsi
+#endif
+		Emit({ 0xFF, 0xE0 });			// jmp rax
+	}
+
+	/*unlinks a block, jumps into it go back through the exit stub and wait for a new one*/
+	void Invalidate(ui16 start) {
+		Entry& e = entries[start];
+		for (ui8* site : e.incoming) {
+			Patch(site, exitStub);
+			waiting[start].push_back(site);
+		}
+		e.incoming.clear();
+
+		for (ui32 a = start; a < e.end; a++) covered[a]--;
+		e.block = nullptr;
+		e.end = 0;
+		e.heat = 0;
+		e.uncompilable = false;
+	}
+
+	/*---------- x86-64 emission ------------*/
+
+	void Emit(std::initializer_list<ui8> bytes) {
+		for (ui8 b : bytes) *cursor++ = b;
+	}
+	void Emit32(i32 v) { memcpy(cursor, &v, 4); cursor += 4; }
+	void Emit16(ui16 v) { memcpy(cursor, &v, 2); cursor += 2; }
+
+	static void Patch(ui8* rel32, const ui8* target) {
+		const i32 rel = i32(target - (rel32 + 4));
+		memcpy(rel32, &rel, 4);
+	}
+
+	//reg is eax, ecx or edx (0 to 2), memory operands are [r8 + disp32]
+	static ui8 ModRM(ui8 reg) { return ui8(0x80 | (reg << 3)); }
+
+	void LoadB(ui8 reg, i32 off) { Emit({ 0x41, 0x0F, 0xB6, ModRM(reg) }); Emit32(off); }			// movzx reg, byte [r8 + off]
+	void LoadW(ui8 reg, i32 off) { Emit({ 0x41, 0x0F, 0xB7, ModRM(reg) }); Emit32(off); }			// movzx reg, word [r8 + off]
+	void StoreB(ui8 reg, i32 off) { Emit({ 0x41, 0x88, ModRM(reg) }); Emit32(off); }				// mov byte [r8 + off], reg8
+	void StoreW(ui8 reg, i32 off) { Emit({ 0x66, 0x41, 0x89, ModRM(reg) }); Emit32(off); }			// mov word [r8 + off], reg16
+	void StoreImmB(i32 off, ui8 v) { Emit({ 0x41, 0xC6, 0x80 }); Emit32(off); Emit({ v }); }		// mov byte [r8 + off], imm8
+	void StoreImmW(i32 off, ui16 v) { Emit({ 0x66, 0x41, 0xC7, 0x80 }); Emit32(off); Emit16(v); }	// mov word [r8 + off], imm16
+	void AddImmB(i32 off, ui8 v) { Emit({ 0x41, 0x80, 0x80 }); Emit32(off); Emit({ v }); }			// add byte [r8 + off], imm8
+	void SubImmB(i32 off, ui8 v) { Emit({ 0x41, 0x80, 0xA8 }); Emit32(off); Emit({ v }); }			// sub byte [r8 + off], imm8
+	void CmpImmB(i32 off, ui8 v) { Emit({ 0x41, 0x80, 0xB8 }); Emit32(off); Emit({ v }); }			// cmp byte [r8 + off], imm8
+
+	//8 bit register to register, op is the r/m8, r8 opcode, src and dst are 0 to 2
+	void Alu8(ui8 op, ui8 dst, ui8 src) { Emit({ op, ui8(0xC0 | (src << 3) | dst) }); }
+
+	void V(ui8 reg, ui8 x) { LoadB(reg, regOff + x); }
+	void SetV(ui8 x, ui8 reg) { StoreB(reg, regOff + x); }
+
+	ui8* Jcc(ui8 cc) { Emit({ 0x0F, cc }); Emit32(0); return cursor - 4; }	// jcc rel32, to be patched
+
+	/*pc = target and leave, through a jump that is linked to target's block when it has one*/
+	void ExitTo(ui16 target) {
+		target &= 0x0FFF;
+		StoreImmW(pcOff, target);
+		Emit({ 0xE9 });
+		Emit32(0);
+		ui8* site = cursor - 4;
+
+		Entry& e = entries[target];
+		if (e.block) {
+			Patch(site, e.block);
+			e.incoming.push_back(site);
+		}
+		else {
+			Patch(site, exitStub);
+			waiting[target].push_back(site);
+		}
+	}
+
+	/*leave with pc already stored*/
+	void ExitDynamic() {
+		Emit({ 0xE9 });
+		Emit32(0);
+		Patch(cursor - 4, exitStub);
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   conditional skip: cc is the jcc opcode that is taken when the next instruction is
+	   skipped, the flags have to be set already
+	-----------------------------------------------------------------------------------*/
+	void SkipExits(ui8 cc, ui16 addr) {
+		ui8* skip = Jcc(cc);
+		ExitTo(addr + 2);
+		Patch(skip, cursor);
+		ExitTo(addr + 4);
+	}
+
+	enum Kind { SIMPLE, TERMINATOR, INTERPRET };
+
+	static Kind Classify(ui16 op) {
+		switch (op & 0xF000) {
+		case 0x0000: return op == 0x00EE ? TERMINATOR : INTERPRET;
+		case 0x1000: case 0x2000: case 0x3000: case 0x4000: case 0xB000: return TERMINATOR;
+		case 0x5000: case 0x9000: return TERMINATOR;
+		case 0x6000: case 0x7000: case 0xA000: return SIMPLE;
+		case 0x8000: {
+			const ui8 n = op & 0xF;
+			return (n <= 0x7 || n == 0xE) ? SIMPLE : INTERPRET;
+		}
+		case 0xE000: return ((op & 0xFF) == 0x9E || (op & 0xFF) == 0xA1) ? TERMINATOR : INTERPRET;
+		case 0xF000:
+			switch (op & 0xFF) {
+			case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: case 0x65: return SIMPLE;
+			default: return INTERPRET;
+			}
+		default: return INTERPRET;
+		}
+	}
+
+	/*---------- translation ------------*/
+
+	void Compile(ui16 start) {
+		Entry& e = entries[start];
+
+		//scan the block: simple instructions, then at most one terminator
+		ui16 addr = start;
+		ui32 count = 0;
+		bool terminated = false;
+		while (count < MAX_INSTRUCTIONS && addr < ADDRESSES - 1) {
+			const Kind kind = Classify(core.fetch(addr));
+			if (kind == INTERPRET) break;
+
+			count++;
+			addr += 2;
+			if (kind == TERMINATOR) {
+				terminated = true;
+				break;
+			}
+		}
+
+		if (!count) {
+			e.uncompilable = true;
+			return;
+		}
+
+		if (cursor + (count + 2) * MAX_INSTRUCTION_BYTES > cache + CACHE_SIZE) {
+			Flush();
+		}
+
+		const ui8* block = cursor;
+
+		//budget check for the whole block
+		Emit({ 0x49, 0x81, 0xF9 }); Emit32(i32(count));		// cmp r9, count
+		Patch(Jcc(0x8C), exitStub);								// jl exit
+		Emit({ 0x49, 0x81, 0xE9 }); Emit32(i32(count));		// sub r9, count
+
+		for (ui16 a = start; a != addr; a += 2) Translate(a, core.fetch(a));
+		if (!terminated) ExitTo(addr);
+
+		e.block = block;
+		e.end = addr;
+		e.heat = 0;
+		for (ui32 a = start; a < addr; a++) covered[a]++;
+		live.push_back(start);
+		compiledBlocks++;
+
+		//link the exits that were waiting for this address
+		for (ui8* site : waiting[start]) {
+			Patch(site, block);
+			e.incoming.push_back(site);
+		}
+		waiting[start].clear();
+	}
+
+	enum : ui8 { EAX = 0, ECX = 1, EDX = 2 };
+
+	void Translate(ui16 addr, ui16 op) {
+		const ui8 x = (op >> 8) & 0xF, y = (op >> 4) & 0xF, n = op & 0xF;
+		const ui8 nn = op & 0xFF;
+		const ui16 nnn = op & 0x0FFF;
+
+		//SUPER-CHIP quirks, as the interpreter decodes them: shifts in place, BXNN
+		const bool schip = core.mode == Chip8Core::MODE_SCHIP;
+		const ui8 shiftSource = schip ? x : y;
+
+		switch (op & 0xF000) {
+		case 0x0000:
+			if (op == 0x00EE) {
+				SubImmB(spOff, 1);									// pc = stack[--sp]
+				LoadB(EAX, spOff);
+				Emit({ 0x41, 0x0F, 0xB7, 0x84, 0x40 }); Emit32(stackOff);	// movzx eax, word [r8 + rax * 2 + stack]
+				StoreW(EAX, pcOff);
+				ExitDynamic();
+			}
+			break;
+		case 0x2000:
+			LoadB(EAX, spOff);										// stack[sp++] = return address
+			Emit({ 0x66, 0x41, 0xC7, 0x84, 0x40 }); Emit32(stackOff); Emit16(ui16((addr + 2) & 0x0FFF));
+			AddImmB(spOff, 1);
+			ExitTo(nnn);
+			break;
+		case 0x1000:
+			ExitTo(nnn);
+			break;
+		case 0x3000:
+			CmpImmB(regOff + x, nn);
+			SkipExits(0x84, addr);	// je
+			break;
+		case 0x4000:
+			CmpImmB(regOff + x, nn);
+			SkipExits(0x85, addr);	// jne
+			break;
+		case 0x5000:
+		case 0x9000:
+			V(EAX, x);
+			Emit({ 0x41, 0x3A, 0x80 }); Emit32(regOff + y);		// cmp al, byte [r8 + Vy]
+			SkipExits((op & 0xF000) == 0x5000 ? 0x84 : 0x85, addr);
+			break;
+		case 0x6000:
+			StoreImmB(regOff + x, nn);
+			break;
+		case 0x7000:
+			AddImmB(regOff + x, nn);
+			break;
+		case 0x8000:
+			switch (n) {
+			case 0x0:
+				V(EAX, y);
+				SetV(x, EAX);
+				break;
+			case 0x1: case 0x2: case 0x3: {
+				static const ui8 ops[4] = { 0, 0x08, 0x20, 0x30 };	// or, and, xor
+				V(EAX, x);
+				V(ECX, y);
+				Alu8(ops[n], EAX, ECX);
+				SetV(x, EAX);
+				break;
+			}
+			case 0x4: {
+				V(EAX, x);
+				V(ECX, y);
+				Emit({ 0x01, 0xC8 });					// add eax, ecx
+				SetV(x, EAX);
+				Emit({ 0xC1, 0xE8, 0x08 });				// shr eax, 8, the carry
+				SetV(0xF, EAX);
+				break;
+			}
+			case 0x5:
+				//both operands stay in registers, Vx can be Vy
+				V(EAX, x);
+				V(ECX, y);
+				Emit({ 0x89, 0xC2 });					// mov edx, eax
+				Alu8(0x28, EAX, ECX);					// sub al, cl
+				SetV(x, EAX);
+				Alu8(0x38, EDX, ECX);					// cmp dl, cl
+				Emit({ 0x0F, 0x93, 0xC0 });				// setae al
+				SetV(0xF, EAX);
+				break;
+			case 0x6:
+				//the source stays in ecx, Vx can be it
+				V(ECX, shiftSource);
+				Emit({ 0x89, 0xC8 });					// mov eax, ecx
+				Emit({ 0xD0, 0xE8 });					// shr al, 1
+				SetV(x, EAX);
+				Emit({ 0x89, 0xC8 });					// mov eax, ecx
+				Emit({ 0x25 }); Emit32(1);				// and eax, 1
+				SetV(0xF, EAX);
+				break;
+			case 0x7:
+				V(EAX, y);
+				V(EDX, x);
+				Emit({ 0x89, 0xC1 });					// mov ecx, eax
+				Alu8(0x28, EAX, EDX);					// sub al, dl
+				SetV(x, EAX);
+				Alu8(0x38, ECX, EDX);					// cmp cl, dl
+				Emit({ 0x0F, 0x93, 0xC0 });				// setae al
+				SetV(0xF, EAX);
+				break;
+			case 0xE:
+				V(ECX, shiftSource);
+				Emit({ 0x89, 0xC8 });					// mov eax, ecx
+				Alu8(0x00, EAX, EAX);					// add al, al
+				SetV(x, EAX);
+				Emit({ 0x89, 0xC8 });					// mov eax, ecx
+				Emit({ 0xC1, 0xE8, 0x07 });				// shr eax, 7
+				SetV(0xF, EAX);
+				break;
+			}
+			break;
+		case 0xA000:
+			StoreImmW(iOff, nnn);
+			break;
+		case 0xB000:
+			V(EAX, schip ? x : 0);							// BXNN: XNN + VX
+			Emit({ 0x05 }); Emit32(nnn);				// add eax, nnn
+			Emit({ 0x25 }); Emit32(0x0FFF);				// and eax, 0xFFF
+			StoreW(EAX, pcOff);
+			ExitDynamic();
+			break;
+		case 0xE000:
+			V(EAX, x);
+			Emit({ 0x25 }); Emit32(0xF);				// and eax, 0xF
+			LoadW(ECX, keysOff);
+			Emit({ 0x0F, 0xA3, 0xC1 });					// bt ecx, eax
+			SkipExits(nn == 0x9E ? 0x82 : 0x83, addr);	// jc, jnc
+			break;
+		case 0xF000:
+			switch (nn) {
+			case 0x07:
+				LoadB(EAX, dtOff);
+				SetV(x, EAX);
+				break;
+			case 0x15:
+				V(EAX, x);
+				StoreB(EAX, dtOff);
+				break;
+			case 0x18:
+				V(EAX, x);
+				StoreB(EAX, stOff);
+				break;
+			case 0x1E:
+				LoadW(EAX, iOff);
+				V(ECX, x);
+				Emit({ 0x01, 0xC8 });					// add eax, ecx
+				Emit({ 0x25 }); Emit32(0x0FFF);
+				StoreW(EAX, iOff);
+				break;
+			case 0x29:
+				V(EAX, x);
+				Emit({ 0x6B, 0xC0, 0x05 });				// imul eax, eax, 5
+				Emit({ 0x05 }); Emit32(core.fntAddr);
+				Emit({ 0x25 }); Emit32(0x0FFF);
+				StoreW(EAX, iOff);
+				break;
+			case 0x65:
+				for (ui8 of = 0; of <= x; of++) {
+					LoadW(EAX, iOff);
+					Emit({ 0x05 }); Emit32(of);
+					Emit({ 0x25 }); Emit32(0x0FFF);
+					Emit({ 0x41, 0x0F, 0xB6, 0x8C, 0x00 }); Emit32(memOff);	// movzx ecx, byte [r8 + rax + mem]
+					SetV(of, ECX);
+				}
+				break;
+			}
+			break;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "RenderTarget.h"
+
+/*---------------------------------------------------------------------------------------
+   Draws a CHIP8 bitboard, ui64 words with bit 63 leftmost, straight into a render
+   target. Each screen byte is expanded through a table of its 8 pixels, already scaled,
+   and every output row of a scaled row is a copy of the first one. Only rows that
+   differ from the last presented frame are expanded again, anything else that draws
+   over the area has to Invalidate it. A second bitplane, as in XO-CHIP, picks each
+   pixel's color out of a palette of 4 instead.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Presenter {
+	voi::MapPixel palette[4];		// indexed by plane 0 bit | plane 1 bit << 1
+	int scale = 1;
+	int x = 0, y = 0;
+
+	std::vector<voi::MapPixel> lut;		// 256 entries of 8 * scale pixels, plane 0 alone
+	std::vector<ui64> shown;			// words of every row of both planes, as last presented
+	bool valid = false;
+
+	//a different target, or the same one resized, starts from nothing
+	const voi::MapPixel* lastTop = nullptr;
+	int lastWidth = 0, lastHeight = 0;
+
+public:
+	Chip8Presenter(voi::MapPixel onColor = { 255, 255, 255 }, voi::MapPixel offColor = { 0, 0, 0 }, int scaleParam = 1) :
+		scale(scaleParam < 1 ? 1 : scaleParam) {
+		palette[0] = offColor;
+		palette[1] = onColor;
+		palette[2] = voi::MapPixel(170, 170, 170);
+		palette[3] = voi::MapPixel(85, 85, 85);
+		BuildTable();
+	}
+
+	void setColors(voi::MapPixel onColor, voi::MapPixel offColor) {
+		palette[0] = offColor;
+		palette[1] = onColor;
+		BuildTable();
+	}
+
+	/*colors of plane 1 alone and of both planes, for 2 plane screens*/
+	void setPlaneColors(voi::MapPixel second, voi::MapPixel both) {
+		palette[2] = second;
+		palette[3] = both;
+		valid = false;
+	}
+
+	/*every CHIP8 pixel becomes scale x scale target pixels*/
+	void setScale(int s) {
+		scale = s < 1 ? 1 : s;
+		BuildTable();
+	}
+
+	/*top-left corner in the target*/
+	void setPosition(int px, int py) {
+		x = px;
+		y = py;
+		valid = false;
+	}
+
+	int getScale() const { return scale; }
+
+	/*next Present redraws every row*/
+	void Invalidate() { valid = false; }
+
+	/*true when Present has to redraw everything, after a settings change or on a different target*/
+	bool Stale(const voi::RenderTarget& target) const {
+		return !valid || target.row(0) != lastTop || target.width() != lastWidth || target.height() != lastHeight;
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   draws the rows that changed since the last call, clipped to the target. width is
+	   the display width in pixels, 64 or 128, stride the words from a row to the next,
+	   the words the width takes when 0. second is the other bitplane, or nullptr.
+	   Returns how many rows it expanded
+	-----------------------------------------------------------------------------------*/
+	int Present(const ui64* rows, int height, const voi::RenderTarget& target, int width = 64, int stride = 0, const ui64* second = nullptr) {
+		const int words = width / 64;
+		const int planes = second ? 2 : 1;
+		const int count = height * words * planes;
+		if (!stride) stride = words;
+
+		if (target.empty()) return 0;
+
+		if (shown.size() != (size_t)count) {
+			shown.assign(count, 0);
+			valid = false;
+		}
+		if (target.row(0) != lastTop || target.width() != lastWidth || target.height() != lastHeight) {
+			lastTop = target.row(0);
+			lastWidth = target.width();
+			lastHeight = target.height();
+			valid = false;
+		}
+
+		const int spanX0 = x < 0 ? -x : 0;
+		const int spanX1 = target.width() - x < width * scale ? target.width() - x : width * scale;
+		if (spanX1 <= spanX0) return 0;
+
+		int expanded = 0;
+		for (int row = 0; row < height; row++) {
+			const ui64* words0 = rows + row * stride;
+			const ui64* words1 = second ? second + row * stride : nullptr;
+			ui64* last = &shown[row * words * planes];
+
+			if (valid && !memcmp(words0, last, words * sizeof(ui64)) && (!words1 || !memcmp(words1, last + words, words * sizeof(ui64)))) continue;
+			memcpy(last, words0, words * sizeof(ui64));
+			if (words1) memcpy(last + words, words1, words * sizeof(ui64));
+
+			const int top = y + row * scale;
+			if (top >= target.height() || top + scale <= 0) continue;
+
+			//first target row with its visible part expanded, the others copy it
+			int first = top < 0 ? 0 : top;
+			voi::MapPixel* dst = target.row(first) + x;
+
+			bool blank1 = true;
+			for (int w = 0; words1 && w < words; w++) blank1 = blank1 && !words1[w];
+
+			if (blank1) Expand(words0, words, dst, spanX0, spanX1);
+			else ExpandPlanes(words0, words1, words, dst, spanX0, spanX1);
+
+			const int end = top + scale < target.height() ? top + scale : target.height();
+			for (int ty = first + 1; ty < end; ty++) {
+				memcpy(target.row(ty) + x + spanX0, dst + spanX0, (spanX1 - spanX0) * sizeof(voi::MapPixel));
+			}
+			expanded++;
+		}
+
+		valid = true;
+		return expanded;
+	}
+
+private:
+	void BuildTable() {
+		const int span = 8 * scale;
+		lut.resize(256 * (size_t)span);
+
+		for (int b = 0; b < 256; b++) {
+			voi::MapPixel* entry = &lut[(size_t)b * span];
+			for (int bit = 0; bit < 8; bit++) {
+				const voi::MapPixel color = (b & (0x80 >> bit)) ? palette[1] : palette[0];
+				for (int s = 0; s < scale; s++) entry[bit * scale + s] = color;
+			}
+		}
+		valid = false;
+	}
+
+	/*pixels [from, to) of a row, in target pixels from the left of the display*/
+	void Expand(const ui64* words, int count, voi::MapPixel* dst, int from, int to) {
+		const int span = 8 * scale;
+
+		for (int w = 0; w < count; w++) {
+			for (int byte = 0; byte < 8; byte++) {
+				const int x0 = (w * 8 + byte) * span;
+				if (x0 + span <= from || x0 >= to) continue;
+
+				const ui8 bits = ui8(words[w] >> (56 - byte * 8));
+				const voi::MapPixel* src = &lut[(size_t)bits * span];
+
+				//whole bytes are one copy, the ones cut by the clip copy their part
+				const int a = x0 < from ? from : x0;
+				const int b = x0 + span > to ? to : x0 + span;
+				memcpy(dst + a, src + (a - x0), (b - a) * sizeof(voi::MapPixel));
+			}
+		}
+	}
+
+	/*both planes, pixel by pixel through the palette, only rows where plane 1 has something*/
+	void ExpandPlanes(const ui64* words0, const ui64* words1, int count, voi::MapPixel* dst, int from, int to) {
+		for (int px = from / scale; px < count * 64 && px * scale < to; px++) {
+			const int w = px >> 6, bit = 63 - (px & 63);
+			const voi::MapPixel color = palette[((words0[w] >> bit) & 1) | (((words1[w] >> bit) & 1) << 1)];
+
+			const int a = px * scale < from ? from : px * scale;
+			const int b = (px + 1) * scale > to ? to : (px + 1) * scale;
+			for (int t = a; t < b; t++) dst[t] = color;
+		}
+	}
+};
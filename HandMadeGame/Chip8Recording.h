@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <fstream>
+#include <cstring>
+
+#include "utilDefs.h"
+#include "Chip8Core.h"
+
+/*---------------------------------------------------------------------------------------
+   Keypad input of a Chip8Core run, stored as the cycles where the key mask changed
+   together with the machine state it started from. With the seeded CXNN that is the
+   whole run: Replay loads the start state and runs the core headless from one key
+   change to the next, so EX9E, EXA1 and FX0A see exactly the keys they saw live, at
+   whatever speed the host goes.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Recording {
+public:
+	struct Event {
+		ui64 cycle;		// core cycle count when the mask was set
+		ui16 keys;
+	};
+
+	enum : ui32 { FILE_MAGIC = 0x43523843 };	// "C8RC"
+
+private:
+	std::vector<ui8> start;
+	std::vector<Event> events;
+	ui32 clockRate = Chip8Core::DEFAULT_CLOCK;
+	ui64 startCycle = 0;
+	ui64 endCycle = 0;
+
+public:
+	bool empty() const { return start.empty(); }
+	const std::vector<Event>& Events() const { return events; }
+	ui64 StartCycle() const { return startCycle; }
+	ui64 EndCycle() const { return endCycle; }
+
+	/*drops what was recorded and starts over from the current state of core*/
+	void Begin(const Chip8Core& core) {
+		start = core.SaveState();
+		events.clear();
+		clockRate = core.ClockRate();
+		startCycle = endCycle = core.Cycles();
+		events.push_back({ startCycle, core.Keys() });
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   call after every SetKeys on core, only changes of the mask are kept. A core that
+	   went back in time, like after a rewind, cuts the recording there first
+	-----------------------------------------------------------------------------------*/
+	void Record(const Chip8Core& core) {
+		if (empty()) return;
+
+		const ui64 now = core.Cycles();
+		if (now < startCycle) {
+			Begin(core);
+			return;
+		}
+		while (events.size() > 1 && events.back().cycle > now) events.pop_back();
+
+		if (events.back().keys != core.Keys()) {
+			if (events.back().cycle == now) events.back().keys = core.Keys();
+			else events.push_back({ now, core.Keys() });
+		}
+		endCycle = now;
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   puts core back at the start and runs the recording up to cycle, or to its end,
+	   with no timing at all. Returns the cycles it ran, 0 if there is nothing recorded
+	-----------------------------------------------------------------------------------*/
+	ui64 Replay(Chip8Core& core, ui64 cycle = ~ui64(0)) const {
+		if (empty()) return 0;
+		if (cycle > endCycle) cycle = endCycle;
+
+		//the clock rate first, setting it restarts the timer phase the state brings
+		core.SetClockRate(clockRate);
+		if (!core.LoadState(start)) return 0;
+
+		for (size_t i = 0; i < events.size() && events[i].cycle <= cycle; i++) {
+			core.Run(events[i].cycle - core.Cycles());
+			core.SetKeys(events[i].keys);
+		}
+		core.Run(cycle - core.Cycles());
+
+		return core.Cycles() - startCycle;
+	}
+
+	/*---------- files: magic, clock rate, cycles, event count, state size, start state, events ------------*/
+
+	bool Save(const char* path) const {
+		if (empty()) return false;
+
+		std::ofstream file(path, std::ios::binary);
+		if (!file) return false;
+
+		const ui32 magic = FILE_MAGIC;
+		const ui32 count = (ui32)events.size();
+		const ui32 stateSize = (ui32)start.size();
+		file.write((const char*)&magic, 4);
+		file.write((const char*)&clockRate, 4);
+		file.write((const char*)&startCycle, 8);
+		file.write((const char*)&endCycle, 8);
+		file.write((const char*)&count, 4);
+		file.write((const char*)&stateSize, 4);
+		file.write((const char*)start.data(), start.size());
+
+		for (const Event& e : events) {
+			file.write((const char*)&e.cycle, 8);
+			file.write((const char*)&e.keys, 2);
+		}
+		return (bool)file;
+	}
+
+	bool Load(const char* path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) return false;
+
+		ui32 magic = 0, count = 0, stateSize = 0;
+		Chip8Recording loaded;
+		file.read((char*)&magic, 4);
+		file.read((char*)&loaded.clockRate, 4);
+		file.read((char*)&loaded.startCycle, 8);
+		file.read((char*)&loaded.endCycle, 8);
+		file.read((char*)&count, 4);
+		file.read((char*)&stateSize, 4);
+		if (!file || magic != FILE_MAGIC || !count || loaded.endCycle < loaded.startCycle) return false;
+		if (stateSize != Chip8Core::StateSize(Chip8Core::MODE_CHIP8) && stateSize != Chip8Core::StateSize(Chip8Core::MODE_XOCHIP)) return false;
+
+		loaded.start.resize(stateSize);
+		file.read((char*)loaded.start.data(), loaded.start.size());
+
+		for (ui32 i = 0; i < count && file; i++) {
+			Event e;
+			file.read((char*)&e.cycle, 8);
+			file.read((char*)&e.keys, 2);
+
+			//events have to go forward in time from the start
+			const ui64 last = loaded.events.empty() ? loaded.startCycle : loaded.events.back().cycle;
+			if (e.cycle < last) return false;
+			loaded.events.push_back(e);
+		}
+		if (!file || !Chip8Core().LoadState(loaded.start)) return false;
+
+		*this = loaded;
+		return true;
+	}
+};
@@ -0,0 +1,182 @@
+#pragma once
+#include <vector>
+#include <cstring>
+
+#include "utilDefs.h"
+#include "Chip8Core.h"
+
+/*---------------------------------------------------------------------------------------
+   Rewind history of a Chip8Core. Only the newest snapshot is kept whole, every older one
+   is stored as its XOR against the next, run-length coded, so a frame where a sprite
+   moved costs a few dozen bytes instead of the whole machine. Deltas go in a fixed
+   ring of bytes, when it is full the oldest ones are dropped. Push once per frame,
+   Rewind walks back one snapshot per call.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Rewind {
+	struct Record {
+		ui32 offset;
+		ui32 size;
+	};
+
+	std::vector<ui8> ring;			// run-length coded deltas, oldest to newest around the ring
+	std::vector<Record> records;	// ring of maxFrames slots
+	ui32 first = 0;					// oldest record slot
+	ui32 count = 0;
+
+	std::vector<ui8> head;			// newest snapshot, whole
+	std::vector<ui8> current;
+	std::vector<ui8> coded;
+	bool hasHead = false;
+
+public:
+	enum : ui32 { DEFAULT_BYTES = 4 << 20, DEFAULT_FRAMES = 60 * 60 };
+
+	/*room for bytes of deltas and at most frames snapshots, a minute at 60 fps by default*/
+	Chip8Rewind(ui32 bytes = DEFAULT_BYTES, ui32 frames = DEFAULT_FRAMES) :
+		ring(bytes), records(frames ? frames : 1) {}
+
+	/*snapshots got stored, the newest whole one included*/
+	ui32 frames() const { return count + (hasHead ? 1 : 0); }
+
+	ui64 usedBytes() const {
+		ui64 used = 0;
+		for (ui32 i = 0; i < count; i++) used += records[(first + i) % records.size()].size;
+		return used;
+	}
+
+	void Clear() {
+		first = count = 0;
+		hasHead = false;
+	}
+
+	/*snapshot of core on top of the history*/
+	void Push(const Chip8Core& core) {
+		const ui32 size = core.StateSize();
+		current.resize(size);
+		core.SaveState(current.data());
+
+		//a state of another mode has nothing to diff against, the history starts over
+		if (hasHead && head.size() != size) Clear();
+
+		if (hasHead) {
+			//the old head becomes a delta against the new one
+			for (ui32 i = 0; i < size; i++) head[i] ^= current[i];
+			Encode(head.data(), size, coded);
+			Store(coded);
+		}
+
+		head.swap(current);
+		hasHead = true;
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   loads the newest snapshot into core and drops it, so the next call goes one
+	   further back. False once the history is empty, core is left as it is then
+	-----------------------------------------------------------------------------------*/
+	bool Rewind(Chip8Core& core) {
+		if (!hasHead) return false;
+
+		core.LoadState(head);
+
+		if (count) {
+			const Record& r = records[(first + count - 1) % records.size()];
+			Decode(&ring[r.offset], r.size, head.data());
+			count--;
+		}
+		else hasHead = false;
+
+		return true;
+	}
+
+private:
+	/*---------- delta coding: runs of zero bytes, then literal bytes, both lengths as varints ------------*/
+
+	static void PutLength(std::vector<ui8>& out, ui32 n) {
+		while (n >= 0x80) {
+			out.push_back(ui8(n | 0x80));
+			n >>= 7;
+		}
+		out.push_back(ui8(n));
+	}
+
+	static ui32 GetLength(const ui8*& p) {
+		ui32 n = 0;
+		for (ui32 shift = 0;; shift += 7) {
+			const ui8 b = *p++;
+			n |= ui32(b & 0x7F) << shift;
+			if (!(b & 0x80)) return n;
+		}
+	}
+
+	static void Encode(const ui8* delta, ui32 size, std::vector<ui8>& out) {
+		out.clear();
+		ui32 i = 0;
+
+		while (i < size) {
+			//zero words are skipped 8 bytes at a time, most of memory never changes
+			const ui32 zeroStart = i;
+			for (ui64 w; i + 8 <= size && (memcpy(&w, delta + i, 8), w == 0);) i += 8;
+			while (i < size && !delta[i]) i++;
+
+			const ui32 litStart = i;
+			while (i < size && (delta[i] || (i + 1 < size && delta[i + 1]))) i++;
+
+			PutLength(out, litStart - zeroStart);
+			PutLength(out, i - litStart);
+			out.insert(out.end(), delta + litStart, delta + i);
+		}
+	}
+
+	/*xors the coded delta back into state*/
+	static void Decode(const ui8* p, ui32 size, ui8* state) {
+		const ui8* end = p + size;
+		ui32 pos = 0;
+
+		while (p < end) {
+			pos += GetLength(p);
+			const ui32 literal = GetLength(p);
+			for (ui32 i = 0; i < literal; i++) state[pos + i] ^= p[i];
+			p += literal;
+			pos += literal;
+		}
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   appends a record after the newest one, wrapping to the start of the ring when it
+	   does not fit before the end. Records it would overlap are the oldest ones and go
+	-----------------------------------------------------------------------------------*/
+	void Store(const std::vector<ui8>& data) {
+		const ui32 size = (ui32)data.size();
+		if (size > ring.size()) {
+			//a delta bigger than the whole ring cuts the history to the head
+			count = 0;
+			return;
+		}
+
+		if (count == records.size()) Drop();
+
+		ui32 pos = 0;
+		if (count) {
+			const Record& newest = records[(first + count - 1) % records.size()];
+			pos = newest.offset + newest.size;
+		}
+
+		if (pos + size > ring.size()) {
+			//the tail past the newest record is abandoned, the records left there are older than the ones at 0
+			while (count && records[first].offset >= pos) Drop();
+			pos = 0;
+		}
+
+		while (count && records[first].offset < pos + size && records[first].offset + records[first].size > pos) Drop();
+
+		memcpy(&ring[pos], data.data(), size);
+		records[(first + count) % records.size()] = { pos, size };
+		count++;
+	}
+
+	void Drop() {
+		first = (first + 1) % records.size();
+		count--;
+	}
+};
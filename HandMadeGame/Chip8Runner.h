@@ -0,0 +1,278 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+#include "utilDefs.h"
+#include "ThreadPool.h"
+#include "Chip8Core.h"
+#include "Chip8Jit.h"
+
+/*---------------------------------------------------------------------------------------
+   Runs batches of ROMs on headless Chip8Cores across a thread pool, to check many of
+   them against the end state they should reach. A job runs for its cycles or until the
+   program stops for good: 00FD, a jump to itself, or FX0A waiting on keys the job never
+   presses. The result hashes the screen and the registers at that point.
+
+   The jobs are split into one contiguous range per lane, the calling thread being one
+   of them. A lane that empties its range steals the top half of the fullest one left,
+   so a few long ROMs do not hold the others up. The cores and the file buffers belong to
+   the lanes and are kept from one batch to the next, so only the first batch allocates.
+---------------------------------------------------------------------------------------*/
+
+class Chip8Runner {
+public:
+	struct Job {
+		std::string path;				// ROM file, read when the job runs
+		const ui8* rom = nullptr;		// or the ROM in memory when path is empty, kept alive by the caller
+		size_t romSize = 0;
+		ui8 mode = Chip8Core::MODE_CHIP8;
+		ui64 cycles = 1000000;			// the most it runs, a halt stops it earlier
+		ui16 keys = 0;					// keypad mask held through the whole run
+		ui64 seed = Chip8Core::DEFAULT_SEED;
+		ui32 clockRate = Chip8Core::DEFAULT_CLOCK;
+	};
+
+	//why a job stopped
+	enum : ui8 { END_CYCLES, END_EXIT, END_SELF_JUMP, END_KEY_WAIT, END_NO_ROM };
+
+	struct Result {
+		ui8 end = END_NO_ROM;
+		ui64 cycles = 0;
+		ui64 screenHash = 0;
+		ui64 registerHash = 0;
+	};
+
+	//the halt patterns are looked for every this many cycles, the cycles a halted job reports are rounded up to it
+	enum : ui32 { CHECK_INTERVAL = 4096 };
+
+private:
+	struct Lane {
+		Chip8Core core;
+		std::vector<ui8> rom;	// file contents of the last job read from disk
+#if defined(_M_X64) || defined(__x86_64__)
+		std::unique_ptr<Chip8Jit> jit;
+#endif
+	};
+
+	voi::ThreadPool& pool;
+	std::vector<std::unique_ptr<Lane>> lanes;
+	bool useJit;
+
+public:
+	/*useJit recompiles each lane's hot code, only worth it for jobs of many millions of cycles*/
+	Chip8Runner(bool useJitParam = false, voi::ThreadPool& poolParam = voi::SharedPool()) :
+		pool(poolParam), useJit(useJitParam) {}
+
+	Chip8Runner(const Chip8Runner& other) = delete;
+	void operator = (const Chip8Runner& other) = delete;
+
+	/*cores kept for the next batch*/
+	ui32 lanesCreated() const { return (ui32)lanes.size(); }
+
+	/*frees the cores, the next batch creates them again*/
+	void Trim() { lanes.clear(); }
+
+	std::vector<Result> Run(const std::vector<Job>& jobs) {
+		std::vector<Result> results(jobs.size());
+		Run(jobs.data(), results.data(), (ui32)jobs.size());
+		return results;
+	}
+
+	/*-----------------------------------------------------------------------------------
+	   runs count jobs and writes their results at the same index, returns once all are
+	   done. Results do not depend on the lane a job ran on. One batch at a time
+	-----------------------------------------------------------------------------------*/
+	void Run(const Job* jobs, Result* results, ui32 count) {
+		if (!count) return;
+
+		const ui32 laneCount = pool.size() + 1 < count ? pool.size() + 1 : count;
+		while (lanes.size() < laneCount) {
+			lanes.emplace_back(new Lane());
+#if defined(_M_X64) || defined(__x86_64__)
+			if (useJit) lanes.back()->jit.reset(new Chip8Jit(lanes.back()->core));
+#endif
+		}
+
+		//helpers that start after the batch is over only touch the state, never the lanes
+		struct State {
+			std::unique_ptr<std::atomic<ui64>[]> ranges;	// begin | end << 32, per lane
+			std::vector<Lane*> lanes;
+			std::atomic<ui32> nextLane{ 1 };
+			std::atomic<ui32> done{ 0 };
+			std::mutex lock;
+			std::condition_variable finished;
+		};
+		std::shared_ptr<State> state = std::make_shared<State>();
+		state->ranges.reset(new std::atomic<ui64>[laneCount]);
+		for (ui32 l = 0; l < laneCount; l++) {
+			state->ranges[l] = Pack(ui32(ui64(count) * l / laneCount), ui32(ui64(count) * (l + 1) / laneCount));
+			state->lanes.push_back(lanes[l].get());
+		}
+
+		auto run = [state, jobs, results, count, laneCount](ui32 self) {
+			for (ui32 job; Claim(state->ranges.get(), laneCount, self, job);) {
+				RunJob(*state->lanes[self], jobs[job], results[job]);
+
+				if (++state->done == count) {
+					std::lock_guard<std::mutex> guard(state->lock);
+					state->finished.notify_all();
+				}
+			}
+		};
+
+		for (ui32 i = 1; i < laneCount; i++) {
+			pool.submit([state, run]() {
+				const ui32 self = state->nextLane++;
+				if (self < state->lanes.size()) run(self);
+			}, voi::ThreadPool::PARALLEL_PRIORITY);
+		}
+
+		run(0);
+
+		std::unique_lock<std::mutex> guard(state->lock);
+		state->finished.wait(guard, [&] { return state->done == count; });
+	}
+
+	/*---------- hashes, FNV-1a 64 ------------*/
+
+	/*visible rows of every plane the mode has, the resolution included so a blank high resolution screen is not a blank low one*/
+	static ui64 ScreenHash(const Chip8Core& core) {
+		const ui8 size[2] = { ui8(core.ScreenWidth()), ui8(core.ScreenHeight()) };
+		ui64 hash = Mix(FNV_OFFSET, size, sizeof(size));
+
+		const ui32 words = core.ScreenWidth() / 64;
+		const ui8 planes = core.Mode() == Chip8Core::MODE_XOCHIP ? 2 : 1;
+		for (ui8 p = 0; p < planes; p++) {
+			const ui64* rows = core.Plane(p);
+			for (int y = 0; y < core.ScreenHeight(); y++) hash = Mix(hash, rows + y * Chip8Core::ROW_WORDS, words * sizeof(ui64));
+		}
+		return hash;
+	}
+
+	/*V0 to VF, I, pc and both timers*/
+	static ui64 RegisterHash(const Chip8Core& core) {
+		ui8 regs[22];
+		for (ui8 x = 0; x < 16; x++) regs[x] = core.V(x);
+		const ui16 i = core.Index(), pc = core.PC();
+		memcpy(regs + 16, &i, 2);
+		memcpy(regs + 18, &pc, 2);
+		regs[20] = core.DelayTimer();
+		regs[21] = core.SoundTimer();
+		return Mix(FNV_OFFSET, regs, sizeof(regs));
+	}
+
+private:
+	enum : ui64 { FNV_OFFSET = 1469598103934665603ull, FNV_PRIME = 1099511628211ull };
+
+	static ui64 Mix(ui64 hash, const void* data, size_t size) {
+		for (const ui8* p = (const ui8*)data; size--; p++) {
+			hash ^= *p;
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	/*---------- scheduling ------------*/
+
+	static ui64 Pack(ui32 begin, ui32 end) { return begin | ui64(end) << 32; }
+	static ui32 Begin(ui64 range) { return ui32(range); }
+	static ui32 End(ui64 range) { return ui32(range >> 32); }
+
+	/*-----------------------------------------------------------------------------------
+	   next job of lane self, from the bottom of its own range, or after stealing the top
+	   half of the fullest range left into its own. False once every range is empty, no
+	   job is ever added back so the lane is done then. A job index is only ever in one
+	   range, so a range value never comes back and the compare exchanges are ABA safe
+	-----------------------------------------------------------------------------------*/
+	static bool Claim(std::atomic<ui64>* ranges, ui32 laneCount, ui32 self, ui32& job) {
+		for (;;) {
+			ui64 own = ranges[self].load();
+			while (Begin(own) < End(own)) {
+				if (ranges[self].compare_exchange_weak(own, Pack(Begin(own) + 1, End(own)))) {
+					job = Begin(own);
+					return true;
+				}
+			}
+
+			ui32 victim = self;
+			ui32 most = 0;
+			ui64 seen = 0;
+			for (ui32 l = 0; l < laneCount; l++) {
+				const ui64 range = ranges[l].load();
+				if (End(range) - Begin(range) > most) {
+					most = End(range) - Begin(range);
+					victim = l;
+					seen = range;
+				}
+			}
+			if (!most) return false;
+
+			//own range is empty, so nobody else can be changing it while the stolen half goes in
+			const ui32 half = (most + 1) / 2;
+			if (ranges[victim].compare_exchange_strong(seen, Pack(Begin(seen), End(seen) - half))) {
+				ranges[self].store(Pack(End(seen) - half, End(seen)));
+			}
+		}
+	}
+
+	/*---------- jobs ------------*/
+
+	static void RunJob(Lane& lane, const Job& job, Result& result) {
+		Chip8Core& core = lane.core;
+		result = Result();
+
+		//the seed goes first, the reset of the load starts the sequence from it
+		core.SetClockRate(job.clockRate);
+		core.SetSeed(job.seed);
+		if (core.Mode() != job.mode) core.SetMode(job.mode);
+
+		const bool loaded = job.path.empty() ? core.LoadRom(job.rom, job.romSize) :
+			ReadFile(job.path.c_str(), lane.rom) && core.LoadRom(lane.rom.data(), lane.rom.size());
+		if (!loaded) return;
+
+		core.SetKeys(job.keys);
+		result.end = END_CYCLES;
+
+		for (ui64 left = job.cycles; left;) {
+			const ui64 slice = left < CHECK_INTERVAL ? left : CHECK_INTERVAL;
+			core.Run(slice);
+			left -= slice;
+
+			if (core.Halted()) result.end = END_EXIT;
+			else if (core.WaitingForKey()) result.end = END_KEY_WAIT;
+			else if (SelfJump(core)) result.end = END_SELF_JUMP;
+			if (result.end != END_CYCLES) break;
+		}
+
+		result.cycles = core.Cycles();
+		result.screenHash = ScreenHash(core);
+		result.registerHash = RegisterHash(core);
+	}
+
+	/*1NNN to its own address, the usual way a CHIP8 program ends*/
+	static bool SelfJump(const Chip8Core& core) {
+		const ui16 pc = core.PC();
+		if (pc >= 0x1000) return false;
+
+		const ui16 op = ui16(core.Memory()[pc] << 8 | core.Memory()[(pc + 1) & (core.MemorySize() - 1)]);
+		return op == (0x1000 | pc);
+	}
+
+	/*whole file into buffer, which keeps its capacity between jobs*/
+	static bool ReadFile(const char* path, std::vector<ui8>& buffer) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) return false;
+
+		const std::streamoff size = file.tellg();
+		if (size < 0) return false;
+		buffer.resize((size_t)size);
+		file.seekg(0);
+		file.read((char*)buffer.data(), size);
+		return (bool)file;
+	}
+};
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "PixelConvert.h"
+#include "Image.h"
+#include "RenderTarget.h"
+#include "ThreadPool.h"
+
+namespace voi {
+
+	enum BlendMode : ui8 {
+		BLEND_NORMAL,	// source over
+		BLEND_ADDITIVE,	// glows and light, saturates at white
+		BLEND_MULTIPLY	// shadows and tints
+	};
+
+	/*---------------------------------------------------------------------------------------
+	   Row blend kernels, src is premultiplied, opacity scales it as a whole. SSE2 does 4
+	   pixels per step in 16 bit lanes, tails go through the same math one pixel at a time.
+	   The 4th byte of dst gets the composited alpha, the screen just ignores it.
+	---------------------------------------------------------------------------------------*/
+
+	namespace composite {
+
+		inline __m128i Widen(__m128i v, bool high) {
+			return high ? _mm_unpackhi_epi8(v, _mm_setzero_si128()) : _mm_unpacklo_epi8(v, _mm_setzero_si128());
+		}
+
+		inline __m128i Alphas(__m128i wide) {
+			return _mm_shufflehi_epi16(_mm_shufflelo_epi16(wide, 0xFF), 0xFF);
+		}
+
+		/*dst + src, the only mode where 8 bit saturation already is the whole formula*/
+		inline void AddRow(MapPixel* dst, const Pixel* src, int count, ui8 opacity) {
+			int i = 0;
+			const __m128i o = _mm_set1_epi16(opacity);
+
+			for (; i + 4 <= count; i += 4) {
+				__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+				__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+				if (opacity != 255) s = _mm_packus_epi16(convert::MulDiv255(Widen(s, false), o), convert::MulDiv255(Widen(s, true), o));
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_adds_epu8(d, s));
+			}
+
+			for (; i < count; i++) {
+				const Pixel s = src[i];
+				MapPixel& d = dst[i];
+				d.b = (ui8)std::min(255, d.b + convert::MulDiv255(s.b, opacity));
+				d.g = (ui8)std::min(255, d.g + convert::MulDiv255(s.g, opacity));
+				d.r = (ui8)std::min(255, d.r + convert::MulDiv255(s.r, opacity));
+				d.x = (ui8)std::min(255, d.x + convert::MulDiv255(s.a, opacity));
+			}
+		}
+
+		/*normal: s + d * (255 - sa), multiply: s * d + s * (255 - da) + d * (255 - sa)*/
+		template<bool Multiply>
+		inline __m128i BlendWide(__m128i s, __m128i d, __m128i o, bool scale) {
+			const __m128i max = _mm_set1_epi16(255);
+			if (scale) s = convert::MulDiv255(s, o);
+
+			__m128i result = _mm_add_epi16(s, convert::MulDiv255(d, _mm_sub_epi16(max, Alphas(s))));
+			if (Multiply) {
+				result = _mm_add_epi16(result, convert::MulDiv255(s, d));
+				result = _mm_sub_epi16(result, convert::MulDiv255(s, Alphas(d)));
+			}
+			return result;
+		}
+
+		template<bool Multiply>
+		inline void BlendRow(MapPixel* dst, const Pixel* src, int count, ui8 opacity) {
+			int i = 0;
+			const __m128i o = _mm_set1_epi16(opacity);
+			const bool scale = opacity != 255;
+
+			for (; i + 4 <= count; i += 4) {
+				const __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+				const __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+				const __m128i lo = BlendWide<Multiply>(Widen(s, false), Widen(d, false), o, scale);
+				const __m128i hi = BlendWide<Multiply>(Widen(s, true), Widen(d, true), o, scale);
+				_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+			}
+
+			for (; i < count; i++) {
+				const ui32 sa = convert::MulDiv255(src[i].a, opacity);
+				ui8* d = (ui8*)&dst[i];
+				const ui8* s = (const ui8*)&src[i];
+				const ui32 da = d[3];
+
+				for (int c = 0; c < 4; c++) {
+					const ui32 sc = convert::MulDiv255(s[c], opacity);
+					i32 v = sc + convert::MulDiv255(d[c], 255 - sa);
+					if (Multiply) v += convert::MulDiv255(sc, d[c]) - convert::MulDiv255(sc, da);
+					d[c] = (ui8)std::min(255, std::max(0, v));
+				}
+			}
+		}
+
+		inline void BlendRow(MapPixel* dst, const Pixel* src, int count, BlendMode mode, ui8 opacity) {
+			switch (mode) {
+			case BLEND_ADDITIVE: AddRow(dst, src, count, opacity); break;
+			case BLEND_MULTIPLY: BlendRow<true>(dst, src, count, opacity); break;
+			default: BlendRow<false>(dst, src, count, opacity); break;
+			}
+		}
+	}
+
+	class Compositor;
+
+	/*---------------------------------------------------------------------------------------
+	   Off-screen layer of a Compositor. Draw into image() through SetRenderTarget, then
+	   Invalidate the part that changed, the compositor only redoes what was invalidated.
+	   Setters invalidate what they change on their own.
+	---------------------------------------------------------------------------------------*/
+
+	class Layer {
+		friend class Compositor;
+
+		Compositor* owner;
+		Image _image;
+		Vec2i _offset{ 0, 0 };
+		ui8 _opacity = 255;
+		BlendMode _mode = BLEND_NORMAL;
+		bool _visible = true;
+
+		Layer(Compositor* compositor, int w, int h) : owner(compositor), _image(w, h, true) {
+			_image.setPremultiplied(true);
+			for (int i = 0; i < w * h; i++) _image.data()[i].u = 0;
+		}
+
+	public:
+		Layer(const Layer& other) = delete;
+		void operator = (const Layer& other) = delete;
+
+		Image& image() { return _image; }
+		const Vec2i& offset() const { return _offset; }
+		ui8 opacity() const { return _opacity; }
+		BlendMode mode() const { return _mode; }
+		bool visible() const { return _visible; }
+
+		/*in target coordinates*/
+		Vec4i bounds() const { return { _offset.x, _offset.y, _image.width(), _image.height() }; }
+
+		void setOffset(int x, int y);
+		void setOpacity(ui8 opacity);
+		void setMode(BlendMode mode);
+		void setVisible(bool visible);
+
+		/*the whole layer or a region of it, in layer coordinates, needs compositing again*/
+		void Invalidate();
+		void Invalidate(int x, int y, int w, int h);
+	};
+
+	/*---------------------------------------------------------------------------------------
+	   Stack of layers composited bottom to top over a background color. Compose only
+	   repaints the dirty rectangles, the rest of the target keeps what the last Compose
+	   left there, so nothing else should draw on the target in between or it has to be
+	   InvalidateAll'd. A HUD that never changes costs nothing after its first frame.
+	---------------------------------------------------------------------------------------*/
+
+	class Compositor {
+		struct Rect { int x0, y0, x1, y1; };
+
+		std::vector<std::unique_ptr<Layer>> layers;
+		std::vector<Rect> dirty;
+		bool allDirty = true;
+		int lastWidth = 0;
+		int lastHeight = 0;
+
+	public:
+		//more dirty rectangles than this are merged into their bounding box
+		enum : ui32 { MAX_DIRTY = 16 };
+
+		Pixel background{ 0, 0, 0, 255 };
+
+		Compositor() {}
+
+		Compositor(const Compositor& other) = delete;
+		void operator = (const Compositor& other) = delete;
+
+		/*new transparent layer on top of the others*/
+		Layer& AddLayer(int w, int h) {
+			layers.emplace_back(new Layer(this, w, h));
+			Layer& layer = *layers.back();
+			layer.Invalidate();
+			return layer;
+		}
+
+		void RemoveLayer(Layer& layer) {
+			for (auto it = layers.begin(); it != layers.end(); it++) {
+				if (it->get() == &layer) {
+					Invalidate(layer.bounds());
+					layers.erase(it);
+					return;
+				}
+			}
+		}
+
+		ui32 count() const { return (ui32)layers.size(); }
+		Layer& layer(ui32 index) { return *layers[index]; }
+
+		/*region in target coordinates that has to be composited again*/
+		void Invalidate(const Vec4i& rect) {
+			if (allDirty || rect.z <= 0 || rect.w <= 0) return;
+
+			Rect r{ rect.x, rect.y, rect.x + rect.z, rect.y + rect.w };
+
+			//overlapping rectangles grow into one, so no pixel is blended twice
+			for (size_t i = 0; i < dirty.size();) {
+				const Rect& d = dirty[i];
+				if (d.x0 <= r.x1 && r.x0 <= d.x1 && d.y0 <= r.y1 && r.y0 <= d.y1) {
+					r = { std::min(r.x0, d.x0), std::min(r.y0, d.y0), std::max(r.x1, d.x1), std::max(r.y1, d.y1) };
+					dirty.erase(dirty.begin() + i);
+					i = 0;
+				}
+				else i++;
+			}
+			dirty.push_back(r);
+
+			if (dirty.size() > MAX_DIRTY) {
+				for (const Rect& d : dirty) r = { std::min(r.x0, d.x0), std::min(r.y0, d.y0), std::max(r.x1, d.x1), std::max(r.y1, d.y1) };
+				dirty.assign(1, r);
+			}
+		}
+
+		void InvalidateAll() {
+			allDirty = true;
+			dirty.clear();
+		}
+
+		/*composites the dirty regions into target, returns how many rectangles it repainted*/
+		ui32 Compose(const RenderTarget& target) {
+			if (target.empty()) return 0;
+
+			if (target.width() != lastWidth || target.height() != lastHeight) {
+				lastWidth = target.width();
+				lastHeight = target.height();
+				InvalidateAll();
+			}
+
+			if (allDirty) dirty.assign(1, Rect{ 0, 0, target.width(), target.height() });
+
+			ui32 repainted = 0;
+			for (Rect r : dirty) {
+				r = { std::max(r.x0, 0), std::max(r.y0, 0), std::min(r.x1, target.width()), std::min(r.y1, target.height()) };
+				if (r.x1 <= r.x0 || r.y1 <= r.y0) continue;
+
+				Repaint(target, r);
+				repainted++;
+			}
+
+			dirty.clear();
+			allDirty = false;
+			return repainted;
+		}
+
+	private:
+		void Repaint(const RenderTarget& target, const Rect& r) {
+			MapPixel clear;
+			clear.u = background.u;
+
+			SharedPool().parallelFor(r.y1 - r.y0, 32, [&](int begin, int end) {
+				for (int y = r.y0 + begin; y < r.y0 + end; y++) {
+					MapPixel* row = target.row(y);
+					std::fill(row + r.x0, row + r.x1, clear);
+
+					for (const std::unique_ptr<Layer>& layer : layers) {
+						if (!layer->_visible || !layer->_opacity) continue;
+
+						const Image& img = layer->_image;
+						const int ly = y - layer->_offset.y;
+						if (ly < 0 || ly >= img.height()) continue;
+
+						const int x0 = std::max(r.x0, layer->_offset.x), x1 = std::min(r.x1, layer->_offset.x + img.width());
+						if (x1 <= x0) continue;
+
+						const Pixel* src = img.data() + (ui64)(img.height() - 1 - ly) * img.width() + (x0 - layer->_offset.x);
+						composite::BlendRow(row + x0, src, x1 - x0, layer->_mode, layer->_opacity);
+					}
+				}
+			});
+		}
+	};
+
+	/*---------- layer setters, they dirty both where the layer was and where it is now ------------*/
+
+	inline void Layer::setOffset(int x, int y) {
+		if (x == _offset.x && y == _offset.y) return;
+		owner->Invalidate(bounds());
+		_offset = { x, y };
+		owner->Invalidate(bounds());
+	}
+
+	inline void Layer::setOpacity(ui8 opacity) {
+		if (opacity == _opacity) return;
+		_opacity = opacity;
+		owner->Invalidate(bounds());
+	}
+
+	inline void Layer::setMode(BlendMode mode) {
+		if (mode == _mode) return;
+		_mode = mode;
+		owner->Invalidate(bounds());
+	}
+
+	inline void Layer::setVisible(bool visible) {
+		if (visible == _visible) return;
+		_visible = visible;
+		owner->Invalidate(bounds());
+	}
+
+	inline void Layer::Invalidate() { owner->Invalidate(bounds()); }
+
+	inline void Layer::Invalidate(int x, int y, int w, int h) {
+		owner->Invalidate({ _offset.x + x, _offset.y + y, w, h });
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Lock free single producer / single consumer ring buffer. One thread may push and one
+	   other thread may front/pop at the same time, CAPACITY has to be a power of two.
+	---------------------------------------------------------------------------------------*/
+
+	template<typename T, ui32 CAPACITY>
+	class SPSCQueue {
+		static_assert(CAPACITY && !(CAPACITY & (CAPACITY - 1)), "SPSCQueue capacity must be a power of two");
+
+		//read and write counters live on their own cache lines so both sides do not fight over one
+		alignas(64) std::atomic<ui32> head{ 0 };
+		alignas(64) std::atomic<ui32> tail{ 0 };
+		alignas(64) T items[CAPACITY];
+
+	public:
+
+		/*producer side, returns false and drops the item when the queue is full*/
+		bool push(const T& item) {
+			const ui32 t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == CAPACITY) return false;
+
+			items[t & (CAPACITY - 1)] = item;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/*consumer side, oldest item or nullptr when empty, valid until pop*/
+		const T* front() const {
+			const ui32 h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return nullptr;
+
+			return &items[h & (CAPACITY - 1)];
+		}
+
+		/*consumer side, only valid after front returned an item*/
+		void pop() {
+			head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		bool pop(T& out) {
+			const T* item = front();
+			if (!item) return false;
+
+			out = *item;
+			pop();
+			return true;
+		}
+
+		bool empty() const { return front() == nullptr; }
+	};
+}
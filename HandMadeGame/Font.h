@@ -0,0 +1,298 @@
+#pragma once
+
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "Image.h"
+#include "MappedFile.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   .vfnt layout, all little endian:
+	     FontHeader
+	     FontGlyph[glyphCount]      sorted by codepoint
+	     FontKerning[kerningCount]  sorted by (left, right) glyph index
+	     Pixel[atlasWidth * atlasHeight], rows stored bottom-up just like Image
+	---------------------------------------------------------------------------------------*/
+
+	struct FontHeader {
+		char magic[4];
+		ui16 version;
+		ui16 lineHeight;
+		ui16 atlasWidth;
+		ui16 atlasHeight;
+		ui32 glyphCount;
+		ui32 kerningCount;
+		ui32 glyphOffset;
+		ui32 kerningOffset;
+		ui32 atlasOffset;
+	};
+
+	struct FontGlyph {
+		ui32 codepoint;
+		ui16 s, t;		// top-left corner of the glyph in the atlas, t measured from the top
+		ui16 w, h;
+		i16 bearingX;	// from pen position to the left side of the glyph
+		i16 bearingY;	// from the top of the line to the top side of the glyph
+		i16 advance;
+		ui16 reserved;
+	};
+
+	struct FontKerning {
+		ui16 left;		// glyph indices
+		ui16 right;
+		i16 amount;
+		ui16 reserved;
+	};
+
+	/*---------- decodes the UTF-8 sequence at str and moves str past it, malformed bytes give U+FFFD ------------*/
+
+	inline ui32 NextCodepoint(const char*& str) {
+		const ui8* p = (const ui8*)str;
+		ui32 cp;
+		int len;
+
+		if (p[0] < 0x80) { str++; return p[0]; }
+		else if ((p[0] & 0xE0) == 0xC0) { cp = p[0] & 0x1F; len = 2; }
+		else if ((p[0] & 0xF0) == 0xE0) { cp = p[0] & 0x0F; len = 3; }
+		else if ((p[0] & 0xF8) == 0xF0) { cp = p[0] & 0x07; len = 4; }
+		else { str++; return 0xFFFD; }
+
+		for (int i = 1; i < len; i++) {
+			if ((p[i] & 0xC0) != 0x80) {
+				str += i;
+				return 0xFFFD;
+			}
+			cp = (cp << 6) | (p[i] & 0x3F);
+		}
+		str += len;
+
+		//overlong encodings, surrogates and out of range values
+		static const ui32 minimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if (cp < minimum[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0xFFFD;
+
+		return cp;
+	}
+
+	class Font {
+		MappedFile _file;
+
+		std::vector<FontGlyph> _ownedGlyphs;
+		std::vector<FontKerning> _ownedKerning;
+
+		const FontGlyph* _glyphs = nullptr;
+		const FontKerning* _kerning = nullptr;
+		ui32 _glyphCount = 0;
+		ui32 _kerningCount = 0;
+
+		int _lineHeight = 0;
+		int _maxAdvance = 0;
+
+		Image _atlas;
+
+		//direct glyph index for every codepoint of the basic multilingual plane
+		std::vector<ui16> _bmp;
+
+		//open addressing table for codepoints above U+FFFF, power of two sized
+		struct AstralEntry { ui32 codepoint; ui16 index; };
+		std::vector<AstralEntry> _astral;
+		ui32 _astralMask = 0;
+
+	public:
+		enum : ui16 { NO_GLYPH = 0xFFFF, VERSION = 1 };
+
+		Font() : _bmp(0x10000, NO_GLYPH) {}
+
+		Font(const Font& other) = delete;
+		void operator = (const Font& other) = delete;
+
+		Font(Font&& other) = default;
+		Font& operator = (Font&& other) = default;
+
+		int lineHeight() const { return _lineHeight; }
+		int maxAdvance() const { return _maxAdvance; }
+		ui32 glyphCount() const { return _glyphCount; }
+		const Image& atlas() const { return _atlas; }
+
+		const FontGlyph& glyph(ui16 index) const { return _glyphs[index]; }
+
+		/*glyph index of the given codepoint, NO_GLYPH if the font does not have it*/
+		ui16 glyphIndex(ui32 codepoint) const {
+			if (codepoint < 0x10000) return _bmp[codepoint];
+			if (_astral.empty()) return NO_GLYPH;
+
+			for (ui32 slot = AstralHash(codepoint) & _astralMask;; slot = (slot + 1) & _astralMask) {
+				if (_astral[slot].codepoint == codepoint) return _astral[slot].index;
+				if (_astral[slot].index == NO_GLYPH) return NO_GLYPH;
+			}
+		}
+
+		/*extra advance between two consecutive glyphs, in atlas pixels*/
+		int kerning(ui16 left, ui16 right) const {
+			if (!_kerningCount) return 0;
+
+			const FontKerning* end = _kerning + _kerningCount;
+			const FontKerning* it = std::lower_bound(_kerning, end, FontKerning{ left, right, 0, 0 },
+				[](const FontKerning& a, const FontKerning& b) {
+					return a.left < b.left || (a.left == b.left && a.right < b.right);
+				});
+
+			if (it != end && it->left == left && it->right == right) return it->amount;
+			return 0;
+		}
+
+		/*maps a .vfnt file, glyph and kerning tables are read straight from the mapping*/
+		bool Load(const char* path) {
+			Font loaded;
+
+			if (!loaded._file.Open(path)) return false;
+
+			const FontHeader* header = loaded._file.at<FontHeader>(0);
+			if (!header || memcmp(header->magic, "VFNT", 4) || header->version != VERSION) return false;
+
+			loaded._glyphs = loaded._file.at<FontGlyph>(header->glyphOffset, header->glyphCount);
+			loaded._kerning = loaded._file.at<FontKerning>(header->kerningOffset, header->kerningCount);
+			const Pixel* atlas = loaded._file.at<Pixel>(header->atlasOffset, (ui64)header->atlasWidth * header->atlasHeight);
+
+			if (!loaded._glyphs || !loaded._kerning || !atlas || !header->lineHeight) return false;
+			if (header->glyphCount >= NO_GLYPH) return false;
+
+			loaded._glyphCount = header->glyphCount;
+			loaded._kerningCount = header->kerningCount;
+			loaded._lineHeight = header->lineHeight;
+
+			loaded._atlas = Image(header->atlasWidth, header->atlasHeight);
+			memcpy(loaded._atlas.data(), atlas, (size_t)header->atlasWidth * header->atlasHeight * sizeof(Pixel));
+
+			loaded.BuildLookup();
+
+			*this = std::move(loaded);
+			return true;
+		}
+
+		bool Save(const char* path) const {
+			if (!_lineHeight || !_atlas.data()) return false;
+
+			std::ofstream file(path, std::ios::binary);
+			if (!file) return false;
+
+			FontHeader header{ {'V','F','N','T'}, VERSION };
+			header.lineHeight = (ui16)_lineHeight;
+			header.atlasWidth = (ui16)_atlas.width();
+			header.atlasHeight = (ui16)_atlas.height();
+			header.glyphCount = _glyphCount;
+			header.kerningCount = _kerningCount;
+			header.glyphOffset = sizeof(FontHeader);
+			header.kerningOffset = header.glyphOffset + _glyphCount * sizeof(FontGlyph);
+			header.atlasOffset = header.kerningOffset + _kerningCount * sizeof(FontKerning);
+
+			file.write((const char*)&header, sizeof(header));
+			file.write((const char*)_glyphs, (std::streamsize)_glyphCount * sizeof(FontGlyph));
+			file.write((const char*)_kerning, (std::streamsize)_kerningCount * sizeof(FontKerning));
+			file.write((const char*)_atlas.data(), (std::streamsize)_atlas.width() * _atlas.height() * sizeof(Pixel));
+
+			return !!file;
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   builds a monospaced font from the old fixed grid bitmap (ASCII 32-126 in rows of
+		   width / fontW cells), cell size is given by the non black marker pixels on the
+		   right column and the bottom row of the bitmap
+		-----------------------------------------------------------------------------------*/
+		static Font FromGrid(Image&& atlas) {
+			Font font;
+
+			const int w = atlas.width(), h = atlas.height();
+			const Pixel black = { 0,0,0 };
+			int cellW = 0, cellH = 0;
+
+			for (int y = 0; y < h; y++) {
+				if (atlas.data()[y * w + (w - 1)].u != black.u) {
+					cellH = y;
+					break;
+				}
+			}
+
+			for (int x = w - 1; x >= 0; x--) {
+				if (atlas.data()[x].u != black.u) {
+					cellW = w - x - 1;
+					break;
+				}
+			}
+
+			if (w <= 0 || cellW <= 0 || cellH <= 2) return font;
+
+			const int charsXWidth = w / cellW;
+
+			for (ui32 c = 32; c < 127; c++) {
+				FontGlyph g{};
+				g.codepoint = c;
+				g.s = ui16(((c - 32) % charsXWidth) * cellW);
+				g.t = ui16(((c - 32) / charsXWidth) * cellH + 1);
+				g.w = ui16(cellW);
+				g.h = ui16(cellH - 2);
+				g.bearingX = 0;
+				g.bearingY = 1;
+				g.advance = i16(cellW);
+
+				font._ownedGlyphs.push_back(g);
+			}
+
+			font._glyphs = font._ownedGlyphs.data();
+			font._glyphCount = (ui32)font._ownedGlyphs.size();
+			font._kerning = font._ownedKerning.data();
+			font._kerningCount = 0;
+			font._lineHeight = cellH;
+			font._atlas = std::move(atlas);
+
+			font.BuildLookup();
+
+			return font;
+		}
+
+		/*converts a grid font bitmap into a .vfnt file*/
+		static bool ConvertGrid(const char* bmpPath, const char* fontPath) {
+			return FromGrid(Image::ReadDecodeImage(bmpPath)).Save(fontPath);
+		}
+
+	private:
+		static ui32 AstralHash(ui32 codepoint) { return (codepoint * 2654435761u) >> 7; }
+
+		void BuildLookup() {
+			std::fill(_bmp.begin(), _bmp.end(), NO_GLYPH);
+			_astral.clear();
+			_astralMask = 0;
+			_maxAdvance = 0;
+
+			ui32 astralCount = 0;
+			for (ui32 i = 0; i < _glyphCount; i++) {
+				if (_glyphs[i].codepoint < 0x10000) _bmp[_glyphs[i].codepoint] = (ui16)i;
+				else astralCount++;
+
+				if (_glyphs[i].advance > _maxAdvance) _maxAdvance = _glyphs[i].advance;
+			}
+
+			if (astralCount) {
+				//at most half full so probe chains stay short
+				ui32 capacity = 16;
+				while (capacity < astralCount * 2) capacity <<= 1;
+
+				_astral.assign(capacity, { 0, NO_GLYPH });
+				_astralMask = capacity - 1;
+
+				for (ui32 i = 0; i < _glyphCount; i++) {
+					if (_glyphs[i].codepoint < 0x10000) continue;
+
+					ui32 slot = AstralHash(_glyphs[i].codepoint) & _astralMask;
+					while (_astral[slot].index != NO_GLYPH) slot = (slot + 1) & _astralMask;
+					_astral[slot] = { _glyphs[i].codepoint, (ui16)i };
+				}
+			}
+		}
+	};
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "ImageEncode.h"
+#include "ThreadPool.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Writes every Nth frame to prefix + frame number + .qoi or .bmp. The render thread
+	   only copies the framebuffer into a recycled buffer, encoding and writing happen on
+	   a background thread. If the writer falls MAX_IN_FLIGHT frames behind new frames are
+	   skipped and counted instead of stalling the loop. Pending frames are written before
+	   the capture is destroyed.
+	---------------------------------------------------------------------------------------*/
+
+	class FrameCapture {
+		std::string prefix;
+		ui32 interval;
+		bool qoi;
+
+		std::mutex lock;
+		std::condition_variable idle;
+		std::vector<std::vector<MapPixel>> freeBuffers;
+		ui32 inFlight = 0;
+		ui64 written = 0;
+		ui64 skipped = 0;
+
+		//last member so the writer is joined before the rest is destroyed
+		ThreadPool writer{ 1 };
+
+	public:
+		enum : ui32 { MAX_IN_FLIGHT = 4 };
+
+		FrameCapture(const char* prefixParam, ui32 everyN = 1, bool qoiParam = true) :
+			prefix(prefixParam), interval(everyN ? everyN : 1), qoi(qoiParam) {}
+
+		FrameCapture(const FrameCapture& other) = delete;
+		void operator = (const FrameCapture& other) = delete;
+
+		~FrameCapture() {
+			std::unique_lock<std::mutex> guard(lock);
+			idle.wait(guard, [this] { return inFlight == 0; });
+		}
+
+		/*render thread, copies the screen when frameNumber is due*/
+		void Frame(const MapPixel* screen, int width, int height, ui64 frameNumber) {
+			if (frameNumber % interval) return;
+
+			std::vector<MapPixel> buffer;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (inFlight >= MAX_IN_FLIGHT) {
+					skipped++;
+					return;
+				}
+				inFlight++;
+
+				if (!freeBuffers.empty()) {
+					buffer = std::move(freeBuffers.back());
+					freeBuffers.pop_back();
+				}
+			}
+
+			buffer.assign(screen, screen + (size_t)width * height);
+
+			char number[32];
+			snprintf(number, sizeof(number), "%06llu", frameNumber);
+			std::string path = prefix + number + (qoi ? ".qoi" : ".bmp");
+
+			writer.submit([this, width, height, path, buffer = std::move(buffer)]() mutable {
+				std::vector<ui8> data;
+				if (qoi) EncodeQOI(buffer.data(), width, height, data);
+				else EncodeBMP(buffer.data(), width, height, data);
+
+				const bool ok = WriteFileData(path.c_str(), data);
+
+				std::lock_guard<std::mutex> guard(lock);
+				if (ok) written++;
+				freeBuffers.push_back(std::move(buffer));
+				inFlight--;
+				idle.notify_all();
+			});
+		}
+
+		ui64 framesWritten() {
+			std::lock_guard<std::mutex> guard(lock);
+			return written;
+		}
+
+		ui64 framesSkipped() {
+			std::lock_guard<std::mutex> guard(lock);
+			return skipped;
+		}
+	};
+}
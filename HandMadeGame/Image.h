@@ -3,74 +3,151 @@
 #include <fstream>
 #include <array>
 #include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
 
 #include "utilDefs.h"
 #include "PixelDefs.h"
+#include "PixelConvert.h"
+#include "PixelAllocator.h"
+#include "MappedFile.h"
+#include "Simd.h"
 
 namespace voi {
-	
+
+	/*---------------------------------------------------------------------------------------
+	   Non owning window over rows of pixels, with the same bottom-up row order as Image.
+	   stride is the distance between rows in pixels, so a view can be a sub-region of a
+	   bigger image, an atlas or a mapped asset. Slicing never copies, the pixels have to
+	   outlive the view.
+	---------------------------------------------------------------------------------------*/
+
+	class ImageView {
+		Pixel* _data = nullptr;	// bottom row
+		int _width = 0;
+		int _height = 0;
+		int _stride = 0;
+		bool _alpha = false;
+		bool _premultiplied = false;
+
+	public:
+		ImageView() {}
+		ImageView(Pixel* data, int w, int h, int stride, bool a = true, bool premultiplied = false) :
+			_data(data), _width(w), _height(h), _stride(stride), _alpha(a), _premultiplied(premultiplied) {}
+
+		int width() const { return _width; }
+		int height() const { return _height; }
+		int stride() const { return _stride; }
+		bool alpha() const { return _alpha; }
+		bool premultiplied() const { return _premultiplied; }
+		bool empty() const { return !_data || _width <= 0 || _height <= 0; }
+		Pixel* data() const { return _data; }
+
+		/*row y counted from the bottom, like Image::data() + y * width*/
+		Pixel* row(int y) const { return _data + (i64)y * _stride; }
+
+		/*region with its top-left corner at x, y measured from the top, clipped to the view*/
+		ImageView sub(int x, int y, int w, int h) const {
+			int x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+			int x1 = x + w > _width ? _width : x + w, y1 = y + h > _height ? _height : y + h;
+			if (x1 <= x0 || y1 <= y0) return ImageView(nullptr, 0, 0, 0, _alpha, _premultiplied);
+
+			return ImageView(row(_height - y1) + x0, x1 - x0, y1 - y0, _stride, _alpha, _premultiplied);
+		}
+	};
 
 	class Image {
 		Pixel* _data = nullptr;
 		int _width = 0;
 		int _height = 0;
 		bool _alpha = false;
+		bool _owned = true;
+		bool _premultiplied = false;
+		PixelAllocator* _allocator = nullptr;	// the one owned pixels go back to
 
 	public:
 		Image() {}
 
-		Image(int w, int h, bool a = true) {
-			_width = abs(w);
-			_height = abs(h);
-			_data = new Pixel[_width * _height];
+		/*opaque black pixels, from the shared pixel allocator unless given another one*/
+		Image(int w, int h, bool a = true, PixelAllocator& allocator = PixelAllocator::Shared()) {
 			_alpha = a;
+			if (!Allocate(abs(w), abs(h), allocator)) return;
+			std::fill(_data, _data + (ui64)_width * _height, Pixel());
 		}
 
-		Image(const Image& other) {
-			if (other._data != nullptr) return;
-			_width = other._width;
-			_height = other._height;
-			_alpha = other._alpha;
-			_data = new Pixel[_width * _height];
-			for (int i = 0; i < _width * _height; i++) {
-				_data[i] = other._data[i];
+		Image(const Image& other) { Copy(other); }
+
+		/*deep copy of the pixels a view shows*/
+		explicit Image(const ImageView& view) {
+			_alpha = view.alpha();
+			_premultiplied = view.premultiplied();
+			if (!Allocate(view.width(), view.height(), PixelAllocator::Shared())) return;
+
+			for (int y = 0; y < _height; y++) {
+				memcpy(_data + (ui64)y * _width, view.row(y), (size_t)_width * sizeof(Pixel));
 			}
 		}
-		Image(Image&& other) {
-			_width = other._width; other._width = 0;
-			_height = other._height; other._height = 0;
-			_data = other._data; other._data = nullptr;
-			_alpha = other._alpha; other._alpha = false;
-		}
 
+		Image(Image&& other) noexcept { Take(other); }
+
+		/*copies always own their pixels, even copies of views*/
 		void operator = (const Image& other) {
-			if (other._data != nullptr) return;
-			_width = other._width;
-			_height = other._height;
-			_alpha = other._alpha;
-			_data = new Pixel[_width * _height];
-			for (int i = 0; i < _width * _height; i++) {
-				_data[i] = other._data[i];
-			}
+			if (this == &other) return;
+			Copy(other);
 		}
-		void operator = (Image&& other) {
-			_width = other._width; other._width = 0;
-			_height = other._height; other._height = 0;
-			_data = other._data; other._data = nullptr;
-			_alpha = other._alpha; other._alpha = false;
+		void operator = (Image&& other) noexcept {
+			if (this == &other) return;
+			Release();
+			Take(other);
 		}
 
-		~Image() {
-			if (_data != nullptr) {
-				delete[] _data;
-				_data = nullptr;
-			}
+		~Image() { Release(); }
+
+		/*image over pixels it does not own, like a mapped asset pack, they must outlive it*/
+		static Image View(Pixel* data, int w, int h, bool a = true, bool premultiplied = false) {
+			Image img;
+			img._data = data;
+			img._width = w;
+			img._height = h;
+			img._alpha = a;
+			img._owned = false;
+			img._premultiplied = premultiplied;
+			return img;
 		}
 
 		int width() const { return _width; }
 		int height() const { return _height; }
 		bool alpha() const { return _alpha; }
+		bool owned() const { return _owned; }
+		bool premultiplied() const { return _premultiplied; }
 		const Pixel* data() const { return _data; }
+		Pixel* data() { return _data; }
+
+		/*whole image as a view, blit functions take views so an Image converts implicitly.
+		  A view of a const Image must only be read*/
+		operator ImageView() const { return ImageView(_data, _width, _height, _width, _alpha, _premultiplied); }
+
+		ImageView view() const { return *this; }
+		ImageView view(int x, int y, int w, int h) const { return view().sub(x, y, w, h); }
+
+		/*stores colors multiplied by their alpha, blending and filtering then skip the per pixel
+		  alpha weighting, best done once right after loading*/
+		void Premultiply() {
+			if (_premultiplied || !_data) return;
+			PremultiplyRow(_data, _data, (ui64)_width * _height);
+			_premultiplied = true;
+		}
+
+		/*only tags how the pixels are stored, for pixels that already are premultiplied*/
+		void setPremultiplied(bool state) { _premultiplied = state; }
+
+		/*back to straight alpha, colors of fully transparent pixels are lost*/
+		void Unpremultiply() {
+			if (!_premultiplied || !_data) return;
+			UnpremultiplyRow(_data, _data, (ui64)_width * _height);
+			_premultiplied = false;
+		}
 
 		bool setPixel(int x, int y, Pixel color) {
 			if (x >= 0 && x < _width && y >= 0 && y < _height) {
@@ -80,450 +157,489 @@ namespace voi {
 			return false;
 		}
 
-		static Image ReadDecodeImage(const char* path) {
+		/*decodes the image at the given path, the image is empty if the file is missing or not supported*/
+		static Image ReadDecodeImage(const char* path, bool premultiply = false) {
 			Image img;
 
-			std::ifstream file(path, std::ios::binary);
-			if (file) {
-				std::string extension(path);
-				extension = extension.substr(extension.size() - 3, 3);
+			std::string extension(path);
+			if (extension.size() < 3) return img;
+			extension = extension.substr(extension.size() - 3, 3);
 
-				if (!extension.compare("bmp")) {
-					DecodeBMP(file, img);
+			if (!extension.compare("bmp") || !extension.compare("qoi")) {
+				MappedFile file(path);
+				if (file.isOpen()) {
+					if (extension[0] == 'b') DecodeBMP(file.data(), file.size(), img);
+					else DecodeQOI(file.data(), file.size(), img);
 				}
 			}
 
-			return std::move(img);
-		}
-
-	private:
-
-		static void DecodeBMP(std::ifstream& file, Image& img) {
-
-			enum compresion : ui32 {
-				RGB, RLE8, RLE4, BITFIELDS, VOI_BM_JPEG, VOI_BM_PNG
-			};
-
-			union {
-				struct BITMAP_INFO_HEADER {
-					ui32 biHeaderSize;
-					i32  biWidth;
-					i32  biHeight;
-					i16  biPlanes;
-					i16  biBitCount;
-					ui32 biCompression;
-					ui32 biByteSize;
-					i32  biXPPM;
-					i32  biYPPM;
-					ui32 biClrUsed;
-					ui32 biClrImportant;
-				} BI;
-
-				struct BITMAP_V5_HEADER {
-					ui32        headerSize;
-					i32         width;
-					i32         height;
-					ui16        planes;
-					ui16        bitCount;
-					ui32        compression;
-					ui32        byteSize;
-					i32         xPPM;
-					i32         yPPM;
-					ui32        clrUsed;
-					ui32        clrImportant;
-					ui32        redMask;
-					ui32        greenMask;
-					ui32        blueMask;
-					ui32        alphaMask;
-					ui32        CSType;
-
-					struct {
-
-						i32 xRed;
-						i32 yRed;
-						i32 zRed;
-						//------------------------------
-						i32 xGreen;
-						i32 yGreen;
-						i32 zGreen;
-						//------------------------------
-						i32 xBlue;
-						i32 yBlue;
-						i32 zBlue;
-
-					} Endpoints;
-
-					ui32        gammaRed;
-					ui32        gammaGreen;
-					ui32        gammaBlue;
-					ui32        intent;
-					ui32        profileData;
-					ui32        profileSize;
-					ui32        reserved;
-				} V5;
-			};
-
-			file.seekg(0, file.end);
-			i32 fileSize = file.tellg();
-			file.seekg(0, file.beg);
-
-			if (fileSize < 14) return;
-
-			char buff[256] = { 0 };
-			file.read(buff, 14);
+			if (premultiply) img.Premultiply();
 
-			std::string aux{ buff };
-
-			if (aux.length() >= 2 && !aux.substr(0, 2).compare("BM")) {
-				ui32 size = *((ui32*)&buff[2]);
+			return img;
+		}
 
-				if (fileSize < size) return;
+		/*-----------------------------------------------------------------------------------
+		   decodes a whole BMP file held in memory, pixels are read straight from it into the
+		   image rows. Supports the core, info and V2 to V5 headers, 1/2/4/8 bit palettes,
+		   16/24/32 bit with or without bitfield masks, RLE8/RLE4 and top-down files.
+		   Returns false and leaves img untouched if the data is not a supported BMP.
+		-----------------------------------------------------------------------------------*/
+		static bool DecodeBMP(const ui8* file, ui64 size, Image& img) {
+			if (size < 18 || file[0] != 'B' || file[1] != 'M') return false;
+
+			const ui32 offset = ReadLE<ui32>(file + 10);
+			const ui32 headerSize = ReadLE<ui32>(file + 14);
+			if (14 + (ui64)headerSize > size || offset > size) return false;
+
+			const ui8* header = file + 14;
+			const ui8* afterHeader = header + headerSize;
+
+			i32 width, height;
+			ui16 bitCount;
+			ui32 compression = BMP_RGB;
+			ui32 clrUsed = 0;
+			ui32 masks[4] = { 0, 0, 0, 0 };	// r g b a
+			int paletteEntrySize = 4;
+
+			if (headerSize == 12) {
+				//BITMAPCOREHEADER, palette entries are 3 bytes
+				width = ReadLE<ui16>(header + 4);
+				height = ReadLE<ui16>(header + 6);
+				bitCount = ReadLE<ui16>(header + 10);
+				paletteEntrySize = 3;
+			}
+			else if (headerSize >= 40) {
+				width = ReadLE<i32>(header + 4);
+				height = ReadLE<i32>(header + 8);
+				bitCount = ReadLE<ui16>(header + 14);
+				compression = ReadLE<ui32>(header + 16);
+				clrUsed = ReadLE<ui32>(header + 32);
+
+				if (headerSize >= 52) {
+					masks[0] = ReadLE<ui32>(header + 40);
+					masks[1] = ReadLE<ui32>(header + 44);
+					masks[2] = ReadLE<ui32>(header + 48);
+				}
+				if (headerSize >= 56) masks[3] = ReadLE<ui32>(header + 52);
 
-				ui32 offset = *((ui32*)&buff[10]);
+				//the plain info header keeps the masks right after it
+				if (headerSize == 40 && (compression == BMP_BITFIELDS || compression == BMP_ALPHABITFIELDS)) {
+					const int count = compression == BMP_ALPHABITFIELDS ? 4 : 3;
+					if ((ui64)(afterHeader - file) + count * 4 > size) return false;
 
-				if (offset >= size) return;
+					for (int i = 0; i < count; i++) masks[i] = ReadLE<ui32>(afterHeader + i * 4);
+					afterHeader += count * 4;
+				}
+			}
+			else {
+				return false;
+			}
 
-				file.read(buff, 4);
-				ui32 headerSize = *((ui32*)buff);
+			const bool topDown = height < 0;
+			if (topDown) {
+				if (height == INT32_MIN || compression == BMP_RLE8 || compression == BMP_RLE4) return false;
+				height = -height;
+			}
+			if (width <= 0 || height <= 0 || (ui64)width * height > MAX_PIXELS) return false;
+
+			//indexed images, missing palette entries are black
+			Pixel palette[256];
+			if (bitCount <= 8) {
+				ui64 count = clrUsed ? clrUsed : (1ull << bitCount);
+				ui64 available = file + offset > afterHeader ? (ui64)(file + offset - afterHeader) / paletteEntrySize : 0;
+				count = std::min<ui64>(std::min<ui64>(count, 256), available);
+
+				for (ui64 i = 0; i < count; i++) {
+					const ui8* entry = afterHeader + i * paletteEntrySize;
+					palette[i] = { entry[2], entry[1], entry[0] };
+				}
+				for (ui64 i = count; i < 256; i++) palette[i] = { 0, 0, 0 };
+			}
 
-				if ((!headerSize) || (headerSize + 14 > offset)) return;
+			const ui8* pixels = file + offset;
+			const ui64 available = size - offset;
 
-				file.read(buff + 4, (long long)headerSize - 4);
+			Image out(width, height, false);
 
-				if (headerSize == 124) {
-					memcpy((void*)&V5, (void*)buff, sizeof(V5));
+			if (compression == BMP_RLE8 || compression == BMP_RLE4) {
+				if (compression == BMP_RLE8 ? bitCount != 8 : bitCount != 4) return false;
+				if (!DecodeRLE(pixels, available, out, compression == BMP_RLE4, palette)) return false;
 
-					//------------------------------------------
-					// aun falta para que esto salga bien
-					//------------------------------------------
+				img = std::move(out);
+				return true;
+			}
 
-					switch (V5.compression) {
-					case BITFIELDS:
-					{
-						if (V5.bitCount == 32) {
+			if (compression != BMP_RGB && compression != BMP_BITFIELDS && compression != BMP_ALPHABITFIELDS) return false;
 
-							img._data = (Pixel*)(new ui8[V5.byteSize]);
+			const ui64 stride = (((ui64)width * bitCount + 31) / 32) * 4;
+			if (stride * height > available) return false;
 
-							file.read((char*)img._data, V5.byteSize);
+			if (compression == BMP_RGB) {
+				//without bitfields the masks in a V4/V5 header are meaningless, 32 bit alpha is unused
+				masks[3] = 0;
+				if (bitCount == 16) { masks[0] = 0x7C00; masks[1] = 0x03E0; masks[2] = 0x001F; }
+				if (bitCount == 32) { masks[0] = 0xFF0000; masks[1] = 0x00FF00; masks[2] = 0x0000FF; }
+			}
 
-							img._alpha = true;
-							img._width = V5.width;
-							img._height = V5.height;
-						}
-					}
-					break;
-					default:
-						return;
-					}
+			out._alpha = masks[3] != 0;
+
+			//the file keeps rows bottom-up unless the height was negative, the image always does
+			auto row = [&](int y) { return out._data + (ui64)(topDown ? height - 1 - y : y) * width; };
+
+			switch (bitCount) {
+			case 1:
+			case 2:
+			case 4:
+			case 8:
+				for (int y = 0; y < height; y++) DecodeIndexedRow(pixels + y * stride, row(y), width, bitCount, palette);
+				break;
+			case 16:
+			{
+				BMPChannel channels[4] = { MakeChannel(masks[0]), MakeChannel(masks[1]), MakeChannel(masks[2]), MakeChannel(masks[3]) };
+				for (int y = 0; y < height; y++) {
+					const ui8* src = pixels + y * stride;
+					Pixel* dst = row(y);
+					for (int x = 0; x < width; x++) dst[x] = DecodeMasked(ReadLE<ui16>(src + x * 2), channels);
 				}
 			}
+			break;
+			case 24:
+				for (int y = 0; y < height; y++) DecodeRow24(pixels + y * stride, row(y), width);
+				break;
+			case 32:
+				for (int y = 0; y < height; y++) DecodeRow32(pixels + y * stride, row(y), width, masks);
+				break;
+			default:
+				return false;
+			}
 
-			return;
+			img = std::move(out);
+			return true;
 		}
-	};
-
-}
-
-
-
 
+		/*decodes a whole QOI file held in memory, false and img untouched if it is not valid*/
+		static bool DecodeQOI(const ui8* file, ui64 size, Image& img) {
+			if (size < 22 || memcmp(file, "qoif", 4)) return false;
 
+			const ui32 width = ReadBE32(file + 4), height = ReadBE32(file + 8);
+			const ui8 channels = file[12];
+			if (!width || !height || width > 0x7FFFFFFF || height > 0x7FFFFFFF || (ui64)width * height > MAX_PIXELS) return false;
+			if (channels != 3 && channels != 4) return false;
 
+			Image out(width, height, channels == 4);
 
+			Pixel index[64];
+			memset(index, 0, sizeof(index));
+			Pixel p{ 0, 0, 0, 255 };
 
+			const ui64 end = size - 8;
+			ui64 i = 14;
+			int run = 0;
 
+			//QOI rows go top-down
+			for (int y = height - 1; y >= 0; y--) {
+				Pixel* row = out._data + (ui64)y * width;
 
+				for (ui32 x = 0; x < width; x++) {
+					if (run) {
+						run--;
+					}
+					else {
+						if (i >= end) return false;
+						const ui8 op = file[i++];
+
+						if (op == 0xFE) {
+							if (i + 3 > end) return false;
+							p.r = file[i]; p.g = file[i + 1]; p.b = file[i + 2];
+							i += 3;
+						}
+						else if (op == 0xFF) {
+							if (i + 4 > end) return false;
+							p.r = file[i]; p.g = file[i + 1]; p.b = file[i + 2]; p.a = file[i + 3];
+							i += 4;
+						}
+						else switch (op & 0xC0) {
+						case 0x00:		// index
+							p = index[op];
+							break;
+						case 0x40:		// small difference
+							p.r += ((op >> 4) & 3) - 2;
+							p.g += ((op >> 2) & 3) - 2;
+							p.b += (op & 3) - 2;
+							break;
+						case 0x80:		// luma difference
+						{
+							if (i >= end) return false;
+							const int dg = (op & 0x3F) - 32;
+							const ui8 next = file[i++];
+							p.r += dg + (next >> 4) - 8;
+							p.g += dg;
+							p.b += dg + (next & 0x0F) - 8;
+						}
+						break;
+						default:		// run
+							run = op & 0x3F;
+							break;
+						}
 
+						index[(p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) & 63] = p;
+					}
 
+					row[x] = p;
+				}
+			}
 
+			img = std::move(out);
+			return true;
+		}
 
+	private:
+		/*owned pixels for a w x h image, leaves it empty when they can not be allocated*/
+		bool Allocate(int w, int h, PixelAllocator& allocator) {
+			_data = (Pixel*)allocator.Allocate((ui64)w * h * sizeof(Pixel));
+			if (!_data) return false;
+
+			_width = w;
+			_height = h;
+			_owned = true;
+			_allocator = &allocator;
+			return true;
+		}
 
+		/*keeps the current buffer when it is owned and already the right size*/
+		void Copy(const Image& other) {
+			const bool reuse = _data && _owned && _width == other._width && _height == other._height;
+			if (!reuse) {
+				Release();
+				if (!other._data || !Allocate(other._width, other._height, other._allocator ? *other._allocator : PixelAllocator::Shared())) {
+					_alpha = other._alpha;
+					_premultiplied = other._premultiplied;
+					return;
+				}
+			}
 
+			memcpy(_data, other._data, (size_t)_width * _height * sizeof(Pixel));
+			_alpha = other._alpha;
+			_premultiplied = other._premultiplied;
+		}
 
+		void Take(Image& other) {
+			_width = other._width; other._width = 0;
+			_height = other._height; other._height = 0;
+			_data = other._data; other._data = nullptr;
+			_alpha = other._alpha; other._alpha = false;
+			_owned = other._owned; other._owned = true;
+			_premultiplied = other._premultiplied; other._premultiplied = false;
+			_allocator = other._allocator; other._allocator = nullptr;
+		}
 
+		void Release() {
+			if (_data && _owned) _allocator->Free(_data, (ui64)_width * _height * sizeof(Pixel));
+			_data = nullptr;
+			_width = 0;
+			_height = 0;
+			_owned = true;
+			_allocator = nullptr;
+		}
 
+		static ui32 ReadBE32(const ui8* p) { return (ui32(p[0]) << 24) | (ui32(p[1]) << 16) | (ui32(p[2]) << 8) | p[3]; }
 
+		enum BMPCompression : ui32 {
+			BMP_RGB, BMP_RLE8, BMP_RLE4, BMP_BITFIELDS, BMP_JPEG, BMP_PNG, BMP_ALPHABITFIELDS
+		};
 
+		//larger images are taken as corrupt headers, 16384 x 16384
+		static const ui64 MAX_PIXELS = 1ull << 28;
 
+		template<typename T>
+		static T ReadLE(const ui8* p) {
+			T value;
+			memcpy(&value, p, sizeof(T));
+			return value;
+		}
 
+		/*---------- bitfield mask channel, scaled to 8 bits on extraction ------------*/
 
+		struct BMPChannel {
+			ui32 mask;
+			int shift;
+			int bits;
+		};
 
+		static BMPChannel MakeChannel(ui32 mask) {
+			BMPChannel channel{ mask, 0, 0 };
+			if (!mask) return channel;
 
+			while (!((mask >> channel.shift) & 1)) channel.shift++;
+			while (channel.shift + channel.bits < 32 && ((mask >> (channel.shift + channel.bits)) & 1)) channel.bits++;
 
+			return channel;
+		}
 
+		static ui8 Extract(ui32 value, const BMPChannel& channel) {
+			if (!channel.bits) return 0;
 
+			const ui32 v = (value & channel.mask) >> channel.shift;
+			if (channel.bits >= 8) return ui8(v >> (channel.bits - 8));
 
+			const ui32 max = (1u << channel.bits) - 1;
+			return ui8((v * 255 + max / 2) / max);
+		}
 
+		static Pixel DecodeMasked(ui32 value, const BMPChannel* channels) {
+			return {
+				Extract(value, channels[0]),
+				Extract(value, channels[1]),
+				Extract(value, channels[2]),
+				channels[3].mask ? Extract(value, channels[3]) : (ui8)255
+			};
+		}
 
+		/*---------- row decoders ------------*/
 
+		static void DecodeIndexedRow(const ui8* src, Pixel* dst, int width, int bitCount, const Pixel* palette) {
+			if (bitCount == 8) {
+				for (int x = 0; x < width; x++) dst[x] = palette[src[x]];
+				return;
+			}
 
+			//leftmost pixel is in the highest bits of each byte
+			const int perByte = 8 / bitCount;
+			const ui8 mask = ui8((1 << bitCount) - 1);
 
+			for (int x = 0; x < width; x++) {
+				const int shift = 8 - bitCount * (x % perByte + 1);
+				dst[x] = palette[(src[x / perByte] >> shift) & mask];
+			}
+		}
 
+		static void DecodeRow24(const ui8* src, Pixel* dst, int width) {
+			int x = 0;
 
+			if (Cpu().ssse3) {
+				//spreads 4 BGR triplets over 4 BGRA pixels, loads 16 bytes so 6 pixels have to be left
+				const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+				const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
 
+				for (; x + 6 <= width; x += 4) {
+					__m128i bgr = _mm_loadu_si128((const __m128i*)(src + x * 3));
+					_mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), opaque));
+				}
+			}
 
+			for (; x < width; x++) dst[x] = { src[x * 3 + 2], src[x * 3 + 1], src[x * 3] };
+		}
 
+		static void DecodeRow32(const ui8* src, Pixel* dst, int width, const ui32* masks) {
+			const bool bgr = masks[0] == 0xFF0000 && masks[1] == 0x00FF00 && masks[2] == 0x0000FF;
 
+			//already the in memory layout
+			if (bgr && masks[3] == 0xFF000000) {
+				memcpy(dst, src, (size_t)width * sizeof(Pixel));
+				return;
+			}
 
+			int x = 0;
 
+			if (bgr && !masks[3]) {
+				const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+				for (; x + 4 <= width; x += 4) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+					_mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(v, opaque));
+				}
+				for (; x < width; x++) dst[x].u = ReadLE<ui32>(src + x * 4) | 0xFF000000;
+				return;
+			}
 
+			//every channel a whole byte, like RGBA or ABGR files, is a single byte shuffle
+			__m128i shuffle;
+			if (Cpu().ssse3 && ByteShuffle(masks, shuffle)) {
+				const __m128i opaque = _mm_set1_epi32(masks[3] ? 0 : (int)0xFF000000);
+				for (; x + 4 <= width; x += 4) {
+					__m128i v = _mm_loadu_si128((const __m128i*)(src + x * 4));
+					_mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), opaque));
+				}
+			}
 
+			BMPChannel channels[4] = { MakeChannel(masks[0]), MakeChannel(masks[1]), MakeChannel(masks[2]), MakeChannel(masks[3]) };
+			for (; x < width; x++) dst[x] = DecodeMasked(ReadLE<ui32>(src + x * 4), channels);
+		}
 
+		/*builds the pshufb control moving each 8 bit mask into its BGRA byte, false if a mask is not a whole byte*/
+		static bool ByteShuffle(const ui32* masks, __m128i& shuffle) {
+			alignas(16) i8 control[16];
+			const int target[4] = { 2, 1, 0, 3 };	// r g b a byte in a Pixel
 
+			for (int c = 0; c < 4; c++) {
+				int source = -1;
+				for (int byte = 0; byte < 4; byte++) {
+					if (masks[c] == (0xFFu << (byte * 8))) source = byte;
+				}
+				if (source < 0 && (c < 3 || masks[c])) return false;
 
+				for (int p = 0; p < 4; p++) control[p * 4 + target[c]] = source < 0 ? -1 : i8(p * 4 + source);
+			}
 
+			shuffle = _mm_load_si128((const __m128i*)control);
+			return true;
+		}
 
+		/*-----------------------------------------------------------------------------------
+		   RLE rows are always bottom-up, pixels skipped by delta or end of line codes are
+		   left transparent
+		-----------------------------------------------------------------------------------*/
+		static bool DecodeRLE(const ui8* src, ui64 size, Image& out, bool rle4, const Pixel* palette) {
+			const int width = out._width, height = out._height;
 
+			memset(out._data, 0, (size_t)width * height * sizeof(Pixel));
+			out._alpha = true;
 
-////TODO: do properly
-//class Image {
-//public:
-//	ui8 error = 0;
-//	enum headerType : ui8 {
-//		VOI_BM_V5_HEADER, VOI_BM_INF_HEADER
-//	};
-//	enum compresion : ui32 {
-//		RGB, RLE8, RLE4, BITFIELDS, VOI_BM_JPEG, VOI_BM_PNG
-//	};
-//	enum ImgError : ui8 {
-//		E_FILE = 0x01, E_ENCODING = 0x02, E_IMPLEMENTATION = 0x04, E_DEBUG = 0x80
-//	};
-//
-//
-//	union {
-//		struct BITMAP_INFO_HEADER {
-//			ui32 biHeaderSize;
-//			i32  biWidth;
-//			i32  biHeight;
-//			i16  biPlanes;
-//			i16  biBitCount;
-//			ui32 biCompression;
-//			ui32 biByteSize;
-//			i32  biXPPM;
-//			i32  biYPPM;
-//			ui32 biClrUsed;
-//			ui32 biClrImportant;
-//		} BI;
-//
-//		struct BITMAP_V5_HEADER {
-//			ui32        headerSize;
-//			i32         width;
-//			i32         height;
-//			ui16        planes;
-//			ui16        bitCount;
-//			ui32        compression;
-//			ui32        byteSize;
-//			i32         xPPM;
-//			i32         yPPM;
-//			ui32        clrUsed;
-//			ui32        clrImportant;
-//			ui32        redMask;
-//			ui32        greenMask;
-//			ui32        blueMask;
-//			ui32        alphaMask;
-//			ui32        CSType;
-//
-//			struct {
-//
-//				i32 xRed;
-//				i32 yRed;
-//				i32 zRed;
-//				//------------------------------
-//				i32 xGreen;
-//				i32 yGreen;
-//				i32 zGreen;
-//				//------------------------------
-//				i32 xBlue;
-//				i32 yBlue;
-//				i32 zBlue;
-//
-//			} Endpoints;
-//
-//			ui32        gammaRed;
-//			ui32        gammaGreen;
-//			ui32        gammaBlue;
-//			ui32        intent;
-//			ui32        profileData;
-//			ui32        profileSize;
-//			ui32        reserved;
-//		} V5;
-//	};
-//	ui8* data = new ui8[1];
-//
-//	/*TODO: change public to here */
-//
-//	~Image() {
-//		if (data != 0) {
-//			delete[] data;
-//		}
-//	}
-//
-//	/*---- setting functions ----*/
-//
-//	/*takes a path to a image file and gets the underlying bitmap*/
-//	void ReadDecodeImage(const char* path) {
-//		std::string pathStr = path;
-//		std::ifstream file(path, std::ios::binary | std::ios::ate);
-//
-//		if (file) {
-//			ui32 fileSize = file.tellg();
-//			file.seekg(0, file.beg);
-//
-//			ui8 possibleError = 0;
-//
-//			if (!pathStr.substr(pathStr.size() - 3, 3).compare("bmp")) {
-//				possibleError = BMPDecoding(file, fileSize);
-//			}
-//			else if (!pathStr.substr(pathStr.size() - 3, 3).compare("png")) {
-//				possibleError = PNGDeconding(file, fileSize);
-//			}
-//
-//			if (possibleError) error |= possibleError;
-//		}
-//		else {
-//			error |= E_FILE;
-//		}
-//	}
-//
-//	/*---- consult functions ----*/
-//
-//	/*Get error info*/
-//	ui8 GetError() { return error; }
-//
-//private:
-//
-//	//---------------------------------------------------------------------------------------------------
-//	// //------------------------------------------------------------------------------------------------
-//	// 
-//	// PNG DECODING FUNCTIONS
-//	// 
-//	// //------------------------------------------------------------------------------------------------
-//	//---------------------------------------------------------------------------------------------------
-//
-//
-//	int PNGDeconding(std::ifstream& file, ui32 fileSize) {
-//		return E_IMPLEMENTATION;
-//	}
-//
-//
-//	//---------------------------------------------------------------------------------------------------
-//	// //------------------------------------------------------------------------------------------------
-//	// 
-//	// BMP DECODING FUNCTIONS
-//	// 
-//	// //------------------------------------------------------------------------------------------------
-//	//---------------------------------------------------------------------------------------------------
-//
-//	int BMPDecoding(std::ifstream& file, ui32 fileSize) {
-//		std::string aux;
-//		char buff[256] = { 0 };
-//
-//		if (fileSize < 14) return E_FILE;
-//
-//		file.read(buff, 14);
-//
-//		aux = { buff };
-//
-//		if (aux.length() >= 2 && !aux.substr(0, 2).compare("BM")) {
-//			ui32 size = *((ui32*)&buff[2]);
-//
-//			if (fileSize < size) return E_FILE;
-//
-//			ui32 offset = *((ui32*)&buff[10]);
-//
-//			if (offset >= size) return E_ENCODING;
-//
-//			file.read(buff, 4);
-//			ui32 headerSize = *((ui32*)buff);
-//
-//			if ((!headerSize) || (headerSize + 14 > offset)) return E_ENCODING;
-//
-//			file.read(buff + 4, (long long)headerSize - 4);
-//
-//			if (headerSize == 124) {
-//				memcpy((void*)&V5, (void*)buff, sizeof(V5));
-//
-//				//------------------------------------------
-//				// aun falta para que esto salga bien
-//				//------------------------------------------
-//
-//				switch (V5.compression) {
-//				case RGB:
-//				{
-//					switch (V5.bitCount) {
-//					case 1:
-//						RGB1BitDataSet(file);
-//						break;
-//
-//					case 2:
-//					{
-//
-//					}
-//
-//					break;
-//
-//					default:
-//						return E_ENCODING;
-//					}
-//				}
-//				break;
-//				case BITFIELDS:
-//				{
-//					if (V5.bitCount == 32) {
-//						delete[] data;
-//
-//						data = new ui8[V5.byteSize];
-//
-//						file.read((char*)data, V5.byteSize);
-//					}
-//				}
-//				break;
-//				case RLE8:
-//				case RLE4:
-//				case VOI_BM_JPEG:
-//				case VOI_BM_PNG:
-//					break;
-//				default:
-//					return E_ENCODING;
-//				}
-//			}
-//		}
-//
-//		return 0;
-//	}
-//
-//	void RGB1BitDataSet(std::ifstream& file) {
-//		char* bitData = new char[V5.byteSize];
-//
-//		file.read(bitData, V5.byteSize);
-//
-//		i64 arrSize = std::abs((i64)V5.width * V5.height);
-//
-//		delete[] data;
-//		data = new ui8[arrSize * 4];
-//
-//		Pixel* pixData = (Pixel*)data;
-//
-//		ui8 mask = 0x80;
-//		for (i64 i = 0; i < V5.byteSize; i++) {
-//			ui8 currByte = bitData[i];
-//			for (i64 j = 0; (mask >> j) > 0; j++) {
-//				if (((i * 8) + j) >= arrSize) goto bit_copy_ended;
-//
-//				if (((mask >> j) & currByte) > 0) pixData[(i * 8) + j] = { 0xFF,0xFF,0xFF };
-//				else pixData[(i * 8) + j] = { 0,0,0 };
-//			}
-//		}
-//
-//	bit_copy_ended:;
-//
-//	};
-//
-//};
+			auto put = [&](int x, int y, ui8 index) {
+				if (x < width && y < height) out._data[y * width + x] = palette[index];
+			};
 
+			int x = 0, y = 0;
+			ui64 i = 0;
 
+			while (i + 1 < size && y < height) {
+				const ui8 count = src[i], value = src[i + 1];
+				i += 2;
 
+				if (count) {
+					//encoded run, RLE4 alternates the two nibbles
+					for (int k = 0; k < count; k++, x++) put(x, y, rle4 ? ((k & 1) ? value & 0x0F : value >> 4) : value);
+					continue;
+				}
 
+				switch (value) {
+				case 0:		// end of line
+					x = 0;
+					y++;
+					break;
+				case 1:		// end of bitmap
+					return true;
+				case 2:		// delta
+					if (i + 1 >= size) return false;
+					x += src[i];
+					y += src[i + 1];
+					i += 2;
+					break;
+				default:	// absolute run, padded to a 16 bit boundary
+				{
+					const ui64 bytes = rle4 ? (value + 1) / 2 : value;
+					if (i + bytes > size) return false;
 
+					for (int k = 0; k < value; k++, x++) {
+						put(x, y, rle4 ? ((k & 1) ? src[i + k / 2] & 0x0F : src[i + k / 2] >> 4) : src[i + k]);
+					}
+					i += (bytes + 1) & ~1ull;
+				}
+				break;
+				}
+			}
 
+			return true;
+		}
+	};
 
+}
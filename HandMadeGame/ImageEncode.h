@@ -0,0 +1,215 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "PixelConvert.h"
+#include "Image.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Image writers. Both formats are lossless, BMP is a 32 bit BITFIELDS file with a V5
+	   header any viewer opens, QOI is a few times smaller and about as fast to write as a
+	   memcpy. Premultiplied images are written with straight alpha. The screen overloads
+	   take the MapPixel framebuffer as it is, top row first, and write it opaque.
+	---------------------------------------------------------------------------------------*/
+
+	namespace encode {
+
+		inline void Put16(std::vector<ui8>& out, ui32 v) { out.push_back(ui8(v)); out.push_back(ui8(v >> 8)); }
+		inline void Put32(std::vector<ui8>& out, ui32 v) { Put16(out, v); Put16(out, v >> 16); }
+		inline void Put32BE(std::vector<ui8>& out, ui32 v) {
+			out.push_back(ui8(v >> 24)); out.push_back(ui8(v >> 16)); out.push_back(ui8(v >> 8)); out.push_back(ui8(v));
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   rows(y, dst) fills dst with the straight alpha pixels of row y counted from the
+		   top, the encoders ask for each row once
+		-----------------------------------------------------------------------------------*/
+
+		template<typename Rows>
+		void BMP(int width, int height, Rows rows, std::vector<ui8>& out) {
+			const ui32 headerSize = 124;
+			const ui32 offset = 14 + headerSize;
+			const ui32 dataSize = (ui32)width * height * 4;
+
+			out.clear();
+			out.reserve(offset + dataSize);
+
+			out.push_back('B'); out.push_back('M');
+			Put32(out, offset + dataSize);
+			Put32(out, 0);
+			Put32(out, offset);
+
+			//BITMAPV5HEADER, sRGB and no color profile
+			Put32(out, headerSize);
+			Put32(out, (ui32)width);
+			Put32(out, (ui32)height);
+			Put16(out, 1);
+			Put16(out, 32);
+			Put32(out, 3);			// BI_BITFIELDS
+			Put32(out, dataSize);
+			Put32(out, 2835);		// 72 dpi
+			Put32(out, 2835);
+			Put32(out, 0);
+			Put32(out, 0);
+			Put32(out, 0x00FF0000);
+			Put32(out, 0x0000FF00);
+			Put32(out, 0x000000FF);
+			Put32(out, 0xFF000000);
+			Put32(out, 0x73524742);	// 'sRGB'
+			out.resize(out.size() + 36 + 12, 0);	// endpoints and gamma
+			Put32(out, 4);			// LCS_GM_IMAGES
+			Put32(out, 0);
+			Put32(out, 0);
+			Put32(out, 0);
+
+			//rows go bottom-up, already the Pixel layout
+			out.resize(offset + (size_t)dataSize);
+			for (int y = 0; y < height; y++) {
+				rows(y, (Pixel*)(out.data() + offset + (size_t)(height - 1 - y) * width * 4));
+			}
+		}
+
+		inline ui32 QOIHash(const Pixel& p) { return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) & 63; }
+
+		template<typename Rows>
+		void QOI(int width, int height, bool alpha, Rows rows, std::vector<ui8>& out) {
+			enum : ui8 { OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xC0, OP_RGB = 0xFE, OP_RGBA = 0xFF };
+
+			out.clear();
+			out.reserve((size_t)width * height + 22);
+
+			out.push_back('q'); out.push_back('o'); out.push_back('i'); out.push_back('f');
+			Put32BE(out, (ui32)width);
+			Put32BE(out, (ui32)height);
+			out.push_back(alpha ? 4 : 3);
+			out.push_back(0);		// sRGB with linear alpha
+
+			Pixel index[64];
+			memset(index, 0, sizeof(index));
+
+			Pixel prev{ 0, 0, 0, 255 };
+			int run = 0;
+
+			std::vector<Pixel> row(width);
+
+			for (int y = 0; y < height; y++) {
+				rows(y, row.data());
+
+				for (int x = 0; x < width; x++) {
+					const Pixel p = row[x];
+
+					if (p.u == prev.u) {
+						if (++run == 62) {
+							out.push_back(ui8(OP_RUN | (run - 1)));
+							run = 0;
+						}
+						continue;
+					}
+
+					if (run) {
+						out.push_back(ui8(OP_RUN | (run - 1)));
+						run = 0;
+					}
+
+					const ui32 slot = QOIHash(p);
+					if (index[slot].u == p.u) {
+						out.push_back(ui8(OP_INDEX | slot));
+					}
+					else {
+						index[slot] = p;
+
+						if (p.a == prev.a) {
+							const i8 dr = i8(p.r - prev.r), dg = i8(p.g - prev.g), db = i8(p.b - prev.b);
+							const int drg = dr - dg, dbg = db - dg;
+
+							if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+								out.push_back(ui8(OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+							}
+							else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+								out.push_back(ui8(OP_LUMA | (dg + 32)));
+								out.push_back(ui8(((drg + 8) << 4) | (dbg + 8)));
+							}
+							else {
+								out.push_back(OP_RGB);
+								out.push_back(p.r); out.push_back(p.g); out.push_back(p.b);
+							}
+						}
+						else {
+							out.push_back(OP_RGBA);
+							out.push_back(p.r); out.push_back(p.g); out.push_back(p.b); out.push_back(p.a);
+						}
+					}
+
+					prev = p;
+				}
+			}
+
+			if (run) out.push_back(ui8(OP_RUN | (run - 1)));
+
+			static const ui8 end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+			out.insert(out.end(), end, end + 8);
+		}
+
+		/*---------- row sources ------------*/
+
+		struct ViewRows {
+			const ImageView& img;
+			void operator()(int y, Pixel* dst) const {
+				const Pixel* src = img.row(img.height() - 1 - y);
+				if (img.premultiplied()) UnpremultiplyRow(src, dst, img.width());
+				else memcpy(dst, src, (size_t)img.width() * sizeof(Pixel));
+			}
+		};
+
+		struct ScreenRows {
+			const MapPixel* screen;
+			int width;
+			void operator()(int y, Pixel* dst) const { FromMapPixelRow(screen + (size_t)y * width, dst, width); }
+		};
+	}
+
+	inline void EncodeBMP(const ImageView& img, std::vector<ui8>& out) {
+		encode::BMP(img.width(), img.height(), encode::ViewRows{ img }, out);
+	}
+	inline void EncodeBMP(const MapPixel* screen, int width, int height, std::vector<ui8>& out) {
+		encode::BMP(width, height, encode::ScreenRows{ screen, width }, out);
+	}
+
+	inline void EncodeQOI(const ImageView& img, std::vector<ui8>& out) {
+		encode::QOI(img.width(), img.height(), img.alpha(), encode::ViewRows{ img }, out);
+	}
+	inline void EncodeQOI(const MapPixel* screen, int width, int height, std::vector<ui8>& out) {
+		encode::QOI(width, height, false, encode::ScreenRows{ screen, width }, out);
+	}
+
+	inline bool WriteFileData(const char* path, const std::vector<ui8>& data) {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) return false;
+
+		file.write((const char*)data.data(), (std::streamsize)data.size());
+		return !!file;
+	}
+
+	/*writes img as BMP or QOI going by the path extension, false for any other one*/
+	inline bool SaveImage(const char* path, const ImageView& img) {
+		if (img.empty()) return false;
+
+		std::string extension(path);
+		if (extension.size() < 3) return false;
+		extension = extension.substr(extension.size() - 3, 3);
+
+		std::vector<ui8> data;
+		if (!extension.compare("bmp")) EncodeBMP(img, data);
+		else if (!extension.compare("qoi")) EncodeQOI(img, data);
+		else return false;
+
+		return WriteFileData(path, data);
+	}
+}
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "Image.h"
+#include "ThreadPool.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Whole image operations, each returns a new Image and leaves the source as it is.
+	   Filtering runs on premultiplied colors so transparent pixels do not bleed their
+	   color into the edges, straight alpha sources get straight alpha results. Kernels
+	   work on 4 float channels at a time and split rows over SharedPool.
+	---------------------------------------------------------------------------------------*/
+
+	enum ResizeFilter : ui8 {
+		RESIZE_BOX,			// area average, sharpest downscale without aliasing
+		RESIZE_BILINEAR,	// triangle filter, widened when downscaling
+		RESIZE_LANCZOS		// 3 lobe windowed sinc, best quality
+	};
+
+	namespace imageops {
+
+		//rows per parallelFor chunk and pixels per vertical pass strip, a strip of
+		//accumulators stays in L1 while the source rows stream through
+		static const int ROW_GRAIN = 16;
+		static const int STRIP = 256;
+
+		inline __m128 Load(Pixel p) {
+			const __m128i zero = _mm_setzero_si128();
+			__m128i v = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)p.u), zero);
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero));
+		}
+
+		inline Pixel Store(__m128 v) {
+			__m128i i = _mm_cvtps_epi32(v);
+			i = _mm_packs_epi32(i, i);
+			return Pixel((ui32)_mm_cvtsi128_si32(_mm_packus_epi16(i, i)));
+		}
+
+		/*premultiplied copy of straight alpha images with alpha, the view itself otherwise*/
+		inline ImageView Premultiplied(const ImageView& src, Image& storage) {
+			if (src.premultiplied() || !src.alpha()) return src;
+
+			storage = Image(src);
+			storage.Premultiply();
+			return storage;
+		}
+
+		inline void Finish(Image& out, const ImageView& src) {
+			//out holds premultiplied colors, back to straight alpha when the source was
+			out.setPremultiplied(src.premultiplied() || src.alpha());
+			if (!src.premultiplied()) out.Unpremultiply();
+		}
+
+		/*---------- separable filter taps, out pixel i reads taps[i] from first[i] on ------------*/
+
+		struct Taps {
+			int count = 0;				// taps per output pixel
+			std::vector<int> first;
+			std::vector<float> weights;	// count per output pixel
+		};
+
+		template<typename Kernel>
+		Taps MakeTaps(int srcSize, int dstSize, float support, Kernel kernel) {
+			Taps taps;
+
+			const float scale = (float)srcSize / (float)dstSize;
+			const float widen = scale > 1.f ? scale : 1.f;
+			const float radius = support * widen;
+
+			//a kernel wider than the source is cut to it, no output pixel can read more pixels than there are
+			const int span = (int)std::ceil(radius) * 2 + 1;
+			taps.count = std::min(span, srcSize);
+			taps.first.resize(dstSize);
+			taps.weights.assign((size_t)dstSize * taps.count, 0.f);
+
+			std::vector<float> raw(span);
+			for (int i = 0; i < dstSize; i++) {
+				const float center = (i + 0.5f) * scale;
+				const int first = (int)std::floor(center - radius);
+
+				float total = 0.f;
+				for (int k = 0; k < span; k++) {
+					raw[k] = kernel((first + k + 0.5f - center) / widen);
+					total += raw[k];
+				}
+				if (total != 0.f) for (int k = 0; k < span; k++) raw[k] /= total;
+
+				//taps past the edges repeat the edge pixel, fold them into it
+				taps.first[i] = std::min(std::max(first, 0), srcSize - taps.count);
+				float* w = &taps.weights[(size_t)i * taps.count];
+				for (int k = 0; k < span; k++) {
+					const int index = std::min(std::max(first + k, 0), srcSize - 1) - taps.first[i];
+					w[std::min(std::max(index, 0), taps.count - 1)] += raw[k];
+				}
+			}
+
+			return taps;
+		}
+
+		inline float Sinc(float x) {
+			if (x == 0.f) return 1.f;
+			x *= F_PI;
+			return std::sin(x) / x;
+		}
+
+		inline Taps FilterTaps(int srcSize, int dstSize, ResizeFilter filter) {
+			switch (filter) {
+			case RESIZE_BOX:
+				return MakeTaps(srcSize, dstSize, 0.5f, [](float x) { return (x >= -0.5f && x < 0.5f) ? 1.f : 0.f; });
+			case RESIZE_LANCZOS:
+				return MakeTaps(srcSize, dstSize, 3.f, [](float x) { return (x > -3.f && x < 3.f) ? Sinc(x) * Sinc(x / 3.f) : 0.f; });
+			default:
+				return MakeTaps(srcSize, dstSize, 1.f, [](float x) { x = std::fabs(x); return x < 1.f ? 1.f - x : 0.f; });
+			}
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   horizontal pass into float rows, then a vertical pass over strips of columns,
+		   src has to be premultiplied already
+		-----------------------------------------------------------------------------------*/
+		inline Image Separable(const ImageView& src, int dstW, int dstH, const Taps& xTaps, const Taps& yTaps) {
+			const int srcH = src.height();
+			std::vector<__m128> rows((size_t)dstW * srcH);
+
+			SharedPool().parallelFor(srcH, ROW_GRAIN, [&](int begin, int end) {
+				for (int y = begin; y < end; y++) {
+					const Pixel* in = src.row(y);
+					__m128* out = &rows[(size_t)y * dstW];
+
+					for (int x = 0; x < dstW; x++) {
+						const Pixel* p = in + xTaps.first[x];
+						const float* w = &xTaps.weights[(size_t)x * xTaps.count];
+
+						__m128 acc = _mm_setzero_ps();
+						for (int k = 0; k < xTaps.count; k++) acc = _mm_add_ps(acc, _mm_mul_ps(Load(p[k]), _mm_set1_ps(w[k])));
+						out[x] = acc;
+					}
+				}
+			});
+
+			Image dst(dstW, dstH, src.alpha());
+
+			SharedPool().parallelFor(dstH, ROW_GRAIN, [&](int begin, int end) {
+				__m128 acc[STRIP];
+
+				for (int y = begin; y < end; y++) {
+					const __m128* in = &rows[(size_t)yTaps.first[y] * dstW];
+					const float* w = &yTaps.weights[(size_t)y * yTaps.count];
+					Pixel* out = dst.data() + (size_t)y * dstW;
+
+					for (int x0 = 0; x0 < dstW; x0 += STRIP) {
+						const int n = std::min(STRIP, dstW - x0);
+
+						for (int x = 0; x < n; x++) acc[x] = _mm_setzero_ps();
+						for (int k = 0; k < yTaps.count; k++) {
+							const __m128* row = in + (size_t)k * dstW + x0;
+							const __m128 weight = _mm_set1_ps(w[k]);
+							for (int x = 0; x < n; x++) acc[x] = _mm_add_ps(acc[x], _mm_mul_ps(row[x], weight));
+						}
+						for (int x = 0; x < n; x++) out[x0 + x] = Store(acc[x]);
+					}
+				}
+			});
+
+			return dst;
+		}
+	}
+
+	/*---------- resampling to any size ------------*/
+
+	inline Image ResizeImage(const ImageView& src, int width, int height, ResizeFilter filter = RESIZE_BILINEAR) {
+		if (src.empty() || width <= 0 || height <= 0) return Image();
+
+		Image storage;
+		ImageView in = imageops::Premultiplied(src, storage);
+
+		Image out = imageops::Separable(in, width, height,
+			imageops::FilterTaps(src.width(), width, filter),
+			imageops::FilterTaps(src.height(), height, filter));
+
+		imageops::Finish(out, src);
+		return out;
+	}
+
+	/*---------- separable gaussian, edges repeat the border pixels ------------*/
+
+	inline Image GaussianBlur(const ImageView& src, float sigma) {
+		if (src.empty()) return Image();
+		if (sigma <= 0.f) return Image(src);
+
+		const float support = std::ceil(3.f * sigma);
+		auto gauss = [sigma, support](float x) { return (x > -support - 0.5f && x < support + 0.5f) ? std::exp(-x * x / (2.f * sigma * sigma)) : 0.f; };
+
+		Image storage;
+		ImageView in = imageops::Premultiplied(src, storage);
+
+		Image out = imageops::Separable(in, src.width(), src.height(),
+			imageops::MakeTaps(src.width(), src.width(), support, gauss),
+			imageops::MakeTaps(src.height(), src.height(), support, gauss));
+
+		imageops::Finish(out, src);
+		return out;
+	}
+
+	/*---------- quarter turns, clockwise as seen on screen, copied in cache sized tiles ------------*/
+
+	inline Image RotateImage90(const ImageView& src, int turns) {
+		turns &= 3;
+		if (src.empty()) return Image();
+		if (!turns) return Image(src);
+
+		const int w = src.width(), h = src.height();
+		const int dstW = (turns & 1) ? h : w, dstH = (turns & 1) ? w : h;
+		const int TILE = 32;
+
+		Image dst(dstW, dstH, src.alpha());
+		dst.setPremultiplied(src.premultiplied());
+
+		const int tileRows = (dstH + TILE - 1) / TILE;
+		SharedPool().parallelFor(tileRows, 1, [&](int begin, int end) {
+			for (int tile = begin; tile < end; tile++) {
+				const int r0 = tile * TILE, r1 = std::min(r0 + TILE, dstH);
+
+				for (int c0 = 0; c0 < dstW; c0 += TILE) {
+					const int c1 = std::min(c0 + TILE, dstW);
+
+					for (int r = r0; r < r1; r++) {
+						Pixel* out = dst.data() + (size_t)r * dstW;
+						for (int c = c0; c < c1; c++) {
+							switch (turns) {
+							case 1: out[c] = src.row(c)[w - 1 - r]; break;
+							case 2: out[c] = src.row(h - 1 - r)[w - 1 - c]; break;
+							default: out[c] = src.row(h - 1 - c)[r]; break;
+							}
+						}
+					}
+				}
+			}
+		});
+
+		return dst;
+	}
+
+	/*---------------------------------------------------------------------------------------
+	   rotation by any angle in radians, clockwise as seen on screen, bilinear sampled.
+	   The result is the bounding box of the rotated image, corners are filled with
+	   background.
+	---------------------------------------------------------------------------------------*/
+	inline Image RotateImage(const ImageView& src, float angle, Pixel background = { 0, 0, 0, 0 }) {
+		if (src.empty()) return Image();
+
+		const float c = std::cos(angle), s = std::sin(angle);
+		const int w = src.width(), h = src.height();
+		const int dstW = std::max(1, (int)std::ceil(std::fabs(w * c) + std::fabs(h * s) - 0.001f));
+		const int dstH = std::max(1, (int)std::ceil(std::fabs(w * s) + std::fabs(h * c) - 0.001f));
+
+		Image storage;
+		ImageView in = imageops::Premultiplied(src, storage);
+
+		Pixel bg = background;
+		if (!src.premultiplied()) PremultiplyRow(&background, &bg, 1);
+		const __m128 bgV = imageops::Load(bg);
+
+		//outside pixels read as background so the edges come out antialiased
+		auto fetch = [&](int x, int y) {
+			if (x < 0 || y < 0 || x >= w || y >= h) return bgV;
+			return imageops::Load(in.row(h - 1 - y)[x]);
+		};
+
+		Image dst(dstW, dstH, true);
+
+		const float cx = w * 0.5f, cy = h * 0.5f, dcx = dstW * 0.5f, dcy = dstH * 0.5f;
+
+		SharedPool().parallelFor(dstH, imageops::ROW_GRAIN, [&](int begin, int end) {
+			for (int y = begin; y < end; y++) {
+				//y counted from the top of the screen, the row from the bottom
+				Pixel* out = dst.data() + (size_t)(dstH - 1 - y) * dstW;
+				const float dy = y + 0.5f - dcy;
+
+				for (int x = 0; x < dstW; x++) {
+					const float dx = x + 0.5f - dcx;
+					const float sx = c * dx + s * dy + cx - 0.5f;
+					const float sy = -s * dx + c * dy + cy - 0.5f;
+
+					const float fx = std::floor(sx), fy = std::floor(sy);
+					const int ix = (int)fx, iy = (int)fy;
+
+					if (ix < -1 || iy < -1 || ix >= w || iy >= h) {
+						out[x] = bg;
+						continue;
+					}
+
+					const __m128 tx = _mm_set1_ps(sx - fx), ty = _mm_set1_ps(sy - fy);
+					const __m128 p00 = fetch(ix, iy), p10 = fetch(ix + 1, iy);
+					const __m128 p01 = fetch(ix, iy + 1), p11 = fetch(ix + 1, iy + 1);
+
+					const __m128 top = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(p10, p00), tx));
+					const __m128 bottom = _mm_add_ps(p01, _mm_mul_ps(_mm_sub_ps(p11, p01), tx));
+					out[x] = imageops::Store(_mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), ty)));
+				}
+			}
+		});
+
+		//the corners always bring alpha in, even for opaque sources
+		dst.setPremultiplied(true);
+		if (!src.premultiplied()) dst.Unpremultiply();
+		return dst;
+	}
+
+	/*---------------------------------------------------------------------------------------
+	   color matrix, row major 4 x 5: each output channel r, g, b, a is
+	   m[0] * r + m[1] * g + m[2] * b + m[3] * a + m[4], offsets in 0-255 units.
+	   Applied in place on straight alpha colors.
+	---------------------------------------------------------------------------------------*/
+	inline void ApplyColorMatrix(const ImageView& img, const float matrix[20]) {
+		if (img.empty()) return;
+
+		//one column per input channel, lanes in Pixel byte order b g r a
+		auto column = [matrix](int i) { return _mm_setr_ps(matrix[10 + i], matrix[5 + i], matrix[i], matrix[15 + i]); };
+		const __m128 cr = column(0), cg = column(1), cb = column(2), ca = column(3), offset = column(4);
+		const __m128 zero = _mm_setzero_ps(), max = _mm_set1_ps(255.f);
+
+		SharedPool().parallelFor(img.height(), imageops::ROW_GRAIN, [&](int begin, int end) {
+			std::vector<Pixel> straight(img.premultiplied() ? img.width() : 0);
+
+			for (int y = begin; y < end; y++) {
+				Pixel* row = img.row(y);
+				Pixel* in = row;
+				if (img.premultiplied()) {
+					UnpremultiplyRow(row, straight.data(), img.width());
+					in = straight.data();
+				}
+
+				for (int x = 0; x < img.width(); x++) {
+					const __m128 p = imageops::Load(in[x]);
+
+					__m128 v = _mm_add_ps(offset, _mm_mul_ps(cb, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))));
+					v = _mm_add_ps(v, _mm_mul_ps(cg, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+					v = _mm_add_ps(v, _mm_mul_ps(cr, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+					v = _mm_add_ps(v, _mm_mul_ps(ca, _mm_shuffle_ps(p, p, _MM_SHUFFLE(3, 3, 3, 3))));
+
+					in[x] = imageops::Store(_mm_min_ps(_mm_max_ps(v, zero), max));
+				}
+
+				if (img.premultiplied()) PremultiplyRow(in, row, img.width());
+			}
+		});
+	}
+}
@@ -37,6 +37,7 @@ namespace voi {
 		virtual void restoreStyle() {
 			backColor = backColorMemory;
 			borderColor = borderColorMemory;
+			markDirty();
 		}
 
 		void setBackOverColor(ui8 r, ui8 g, ui8 b, ui8 a = 255) { setBackOverColor({ r,g,b,a }); }
@@ -84,17 +85,36 @@ namespace voi {
 		virtual bool ifOnOver(const MouseInf& info) {
 
 			lastInfo = info;
+			return setHover(Box::ifOnOver(info));
+		}
+
+		virtual void onMouseEnter(const MouseInf& info) override {
+			lastInfo = info;
+			setHover(true);
+		}
+
+		virtual void onMouseLeave(const MouseInf& info) override {
+			lastInfo = info;
+			setHover(false);
+		}
+
+	protected:
+
+		bool setHover(bool state) {
+			over = state;
+
 			if (isClicked || isActive)
 			{
-				return Box::ifOnOver(info);
+				return over;
 			}
 
-			if (Box::ifOnOver(info)) {
+			if (over) {
 				if (!movedIn) {
 					movedIn = true;
 
 					backColor = backOverColor;
 					borderColor = borderOverColor;
+					markDirty();
 				}
 			}
 			else if (movedIn) {
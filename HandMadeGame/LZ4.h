@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   LZ4 block format: sequences of a token (literal length << 4 | match length - 4),
+	   extra length bytes, literals and a 16 bit match offset. The last 5 bytes are always
+	   literals and the last match starts at least 12 bytes before the end, like the
+	   reference implementation, so its decoders can read the output.
+	---------------------------------------------------------------------------------------*/
+
+	namespace lz4 {
+
+		static const int HASH_BITS = 16;
+		static const ui64 MIN_MATCH = 4;
+		static const ui64 MAX_OFFSET = 65535;
+		static const ui64 LAST_LITERALS = 5;
+		static const ui64 MATCH_LIMIT = 12;
+
+		inline ui32 Read32(const ui8* p) {
+			ui32 v;
+			memcpy(&v, p, 4);
+			return v;
+		}
+
+		inline void WriteLength(std::vector<ui8>& out, ui64 length) {
+			for (; length >= 255; length -= 255) out.push_back(255);
+			out.push_back((ui8)length);
+		}
+
+		inline void WriteSequence(std::vector<ui8>& out, const ui8* literals, ui64 literalLength, ui64 offset, ui64 matchLength) {
+			const ui64 match = matchLength ? matchLength - MIN_MATCH : 0;
+
+			out.push_back(ui8(((literalLength < 15 ? literalLength : 15) << 4) | (match < 15 ? match : 15)));
+			if (literalLength >= 15) WriteLength(out, literalLength - 15);
+
+			out.insert(out.end(), literals, literals + literalLength);
+			if (!matchLength) return;
+
+			out.push_back(ui8(offset));
+			out.push_back(ui8(offset >> 8));
+			if (match >= 15) WriteLength(out, match - 15);
+		}
+	}
+
+	/*greedy single pass compressor, out is replaced with the compressed block*/
+	inline void LZ4Compress(const ui8* src, ui64 size, std::vector<ui8>& out) {
+		using namespace lz4;
+
+		out.clear();
+		out.reserve(size + size / 255 + 16);
+
+		//last position + 1 where each 4 byte sequence was seen
+		std::vector<ui32> table((size_t)1 << HASH_BITS, 0);
+
+		ui64 anchor = 0;
+		ui64 i = 0;
+
+		while (size > MATCH_LIMIT && i < size - MATCH_LIMIT) {
+			const ui32 sequence = Read32(src + i);
+			const ui32 hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+
+			const ui64 candidate = table[hash];
+			table[hash] = ui32(i + 1);
+
+			if (!candidate || i - (candidate - 1) > MAX_OFFSET || Read32(src + candidate - 1) != sequence) {
+				i++;
+				continue;
+			}
+
+			const ui64 ref = candidate - 1;
+			ui64 length = MIN_MATCH;
+			while (i + length < size - LAST_LITERALS && src[ref + length] == src[i + length]) length++;
+
+			WriteSequence(out, src + anchor, i - anchor, i - ref, length);
+
+			i += length;
+			anchor = i;
+		}
+
+		WriteSequence(out, src + anchor, size - anchor, 0, 0);
+	}
+
+	/*decodes a whole block, false if it is corrupt or does not decode to exactly dstSize bytes*/
+	inline bool LZ4Decompress(const ui8* src, ui64 srcSize, ui8* dst, ui64 dstSize) {
+		ui64 s = 0, d = 0;
+
+		auto readLength = [&](ui64& length) {
+			ui8 byte;
+			do {
+				if (s >= srcSize) return false;
+				byte = src[s++];
+				length += byte;
+			} while (byte == 255);
+			return true;
+		};
+
+		while (s < srcSize) {
+			const ui8 token = src[s++];
+
+			ui64 literals = token >> 4;
+			if (literals == 15 && !readLength(literals)) return false;
+			if (literals > srcSize - s || literals > dstSize - d) return false;
+
+			memcpy(dst + d, src + s, literals);
+			s += literals;
+			d += literals;
+
+			//the last sequence has no match
+			if (s == srcSize) break;
+			if (srcSize - s < 2) return false;
+
+			const ui64 offset = src[s] | ((ui64)src[s + 1] << 8);
+			s += 2;
+			if (!offset || offset > d) return false;
+
+			ui64 length = token & 15;
+			if (length == 15 && !readLength(length)) return false;
+			length += lz4::MIN_MATCH;
+			if (length > dstSize - d) return false;
+
+			ui8* out = dst + d;
+			const ui8* ref = out - offset;
+			if (offset >= length) {
+				memcpy(out, ref, length);
+			}
+			else {
+				//overlapping match repeats the last offset bytes
+				for (ui64 i = 0; i < length; i++) out[i] = ref[i];
+			}
+			d += length;
+		}
+
+		return d == dstSize;
+	}
+}
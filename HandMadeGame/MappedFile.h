@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Windows.h>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------- Read only view of a whole file mapped in memory ------------*/
+
+	class MappedFile {
+		HANDLE _file = INVALID_HANDLE_VALUE;
+		HANDLE _mapping = NULL;
+		const ui8* _data = nullptr;
+		ui64 _size = 0;
+		bool _writable = false;
+
+	public:
+		MappedFile() {}
+		MappedFile(const char* path, bool copyOnWrite = false) { Open(path, copyOnWrite); }
+
+		MappedFile(const MappedFile& other) = delete;
+		void operator = (const MappedFile& other) = delete;
+
+		MappedFile(MappedFile&& other) { Take(other); }
+		void operator = (MappedFile&& other) {
+			if (this == &other) return;
+			Close();
+			Take(other);
+		}
+
+		~MappedFile() { Close(); }
+
+		/*maps the file at the given path, returns false if it can not be opened or is empty.
+		  A copy on write mapping can be written through mutableData, the file is never changed*/
+		bool Open(const char* path, bool copyOnWrite = false) {
+			Close();
+
+			_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+			if (_file == INVALID_HANDLE_VALUE) return false;
+
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+				Close();
+				return false;
+			}
+
+			_mapping = CreateFileMappingA(_file, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+			if (!_mapping) {
+				Close();
+				return false;
+			}
+
+			_data = (const ui8*)MapViewOfFile(_mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+			if (!_data) {
+				Close();
+				return false;
+			}
+
+			_size = (ui64)size.QuadPart;
+			_writable = copyOnWrite;
+			return true;
+		}
+
+		void Close() {
+			if (_data) UnmapViewOfFile(_data);
+			if (_mapping) CloseHandle(_mapping);
+			if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+
+			_data = nullptr;
+			_mapping = NULL;
+			_file = INVALID_HANDLE_VALUE;
+			_size = 0;
+			_writable = false;
+		}
+
+		bool isOpen() const { return _data != nullptr; }
+		const ui8* data() const { return _data; }
+		ui64 size() const { return _size; }
+
+		/*only for copy on write mappings, nullptr otherwise*/
+		ui8* mutableData() { return _writable ? (ui8*)_data : nullptr; }
+
+		/*returns a pointer to a T at the given byte offset, or nullptr if count T's do not fit in the file*/
+		template<typename T>
+		const T* at(ui64 offset, ui64 count = 1) const {
+			if (!_data || offset > _size || count > (_size - offset) / sizeof(T)) return nullptr;
+			return (const T*)(_data + offset);
+		}
+
+	private:
+		void Take(MappedFile& other) {
+			_file = other._file; other._file = INVALID_HANDLE_VALUE;
+			_mapping = other._mapping; other._mapping = NULL;
+			_data = other._data; other._data = nullptr;
+			_size = other._size; other._size = 0;
+			_writable = other._writable; other._writable = false;
+		}
+	};
+}
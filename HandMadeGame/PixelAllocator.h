@@ -0,0 +1,141 @@
+#pragma once
+
+#include <new>
+#include <mutex>
+#include <vector>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Pixel buffer allocator with size classes, 4 per power of two from MIN_BLOCK up to
+	   MAX_POOLED bytes, so a class wastes at most a quarter of a block. Freed blocks are
+	   kept per class and handed out again, short lived images made every frame reuse the
+	   same few blocks instead of fragmenting the heap. The cache is capped at cacheLimit
+	   bytes, blocks past it and blocks bigger than MAX_POOLED go back to the heap.
+	   Every block is ALIGNMENT aligned so rows can be loaded with aligned SIMD loads.
+	   Thread safe, images are created on loader and worker threads too.
+	---------------------------------------------------------------------------------------*/
+
+	class PixelAllocator {
+		enum : ui32 {
+			MIN_SHIFT = 8,
+			MAX_SHIFT = 26,
+			STEPS = 4,
+			CLASSES = 1 + (MAX_SHIFT - MIN_SHIFT) * STEPS
+		};
+
+		std::mutex lock;
+		std::vector<void*> freeBlocks[CLASSES];
+		ui64 cached = 0;
+		ui64 limit;
+
+	public:
+		enum : ui64 {
+			ALIGNMENT = 64,
+			MIN_BLOCK = 1ull << MIN_SHIFT,
+			MAX_POOLED = 1ull << MAX_SHIFT
+		};
+
+		PixelAllocator(ui64 cacheLimit = 128ull << 20) : limit(cacheLimit) {}
+
+		PixelAllocator(const PixelAllocator& other) = delete;
+		void operator = (const PixelAllocator& other) = delete;
+
+		~PixelAllocator() { Trim(); }
+
+		/*allocator Image uses unless given another one. It is never destroyed so images
+		  that outlive main can still give their blocks back*/
+		static PixelAllocator& Shared() {
+			static PixelAllocator* shared = new PixelAllocator();
+			return *shared;
+		}
+
+		/*block of at least bytes, nullptr for 0 bytes or when out of memory*/
+		void* Allocate(ui64 bytes) {
+			if (!bytes) return nullptr;
+
+			ui64 size;
+			const ui32 index = Class(bytes, size);
+
+			if (index < CLASSES) {
+				std::lock_guard<std::mutex> guard(lock);
+				std::vector<void*>& blocks = freeBlocks[index];
+				if (!blocks.empty()) {
+					void* block = blocks.back();
+					blocks.pop_back();
+					cached -= size;
+					return block;
+				}
+			}
+
+			return ::operator new((size_t)size, std::align_val_t(ALIGNMENT), std::nothrow);
+		}
+
+		/*bytes has to be what the block was allocated with*/
+		void Free(void* block, ui64 bytes) {
+			if (!block) return;
+
+			ui64 size;
+			const ui32 index = Class(bytes, size);
+
+			if (index < CLASSES) {
+				std::lock_guard<std::mutex> guard(lock);
+				if (cached + size <= limit) {
+					freeBlocks[index].push_back(block);
+					cached += size;
+					return;
+				}
+			}
+
+			::operator delete(block, std::align_val_t(ALIGNMENT));
+		}
+
+		/*returns every cached block to the heap*/
+		void Trim() {
+			std::lock_guard<std::mutex> guard(lock);
+			for (std::vector<void*>& blocks : freeBlocks) {
+				for (void* block : blocks) ::operator delete(block, std::align_val_t(ALIGNMENT));
+				blocks.clear();
+			}
+			cached = 0;
+		}
+
+		void setCacheLimit(ui64 bytes) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				limit = bytes;
+				if (cached <= limit) return;
+			}
+			Trim();
+		}
+
+		ui64 cachedBytes() {
+			std::lock_guard<std::mutex> guard(lock);
+			return cached;
+		}
+
+	private:
+		/*class index of a request and the block size it gets, CLASSES when it is not pooled*/
+		static ui32 Class(ui64 bytes, ui64& size) {
+			if (bytes <= MIN_BLOCK) {
+				size = MIN_BLOCK;
+				return 0;
+			}
+
+			//2^shift < bytes <= 2^(shift + 1), split in STEPS blocks of 2^shift / STEPS
+			ui32 shift = 0;
+			while ((bytes - 1) >> (shift + 1)) shift++;
+
+			const ui64 step = (1ull << shift) / STEPS;
+			size = (bytes + step - 1) & ~(step - 1);
+
+			if (size > MAX_POOLED) {
+				size = (bytes + ALIGNMENT - 1) & ~(ui64)(ALIGNMENT - 1);
+				return CLASSES;
+			}
+			return 1 + (shift - MIN_SHIFT) * STEPS + ui32(size / step - STEPS - 1);
+		}
+	};
+}
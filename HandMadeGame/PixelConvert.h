@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstring>
+#include <emmintrin.h>
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Row conversions between Pixel and the other pixel layouts. The SSE2 loops do 4 or 8
+	   pixels at a time, SSE2 is always there on x64, the tails go through the same math
+	   one pixel at a time. src and dst may be the same row when both have the same size.
+	---------------------------------------------------------------------------------------*/
+
+	namespace convert {
+
+		/*x * a / 255 rounded, exact for every 8 bit x and a*/
+		inline ui8 MulDiv255(ui32 x, ui32 a) {
+			const ui32 t = x * a + 128;
+			return ui8((t + (t >> 8)) >> 8);
+		}
+
+		inline __m128i MulDiv255(__m128i x, __m128i a) {
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+
+		/*255 * 65536 / a, so c * 255 / a is a multiply and a shift*/
+		inline const ui32* UnpremultiplyTable() {
+			static const struct Table {
+				ui32 values[256];
+				Table() {
+					values[0] = 0;
+					for (ui32 a = 1; a < 256; a++) values[a] = ((255u << 16) + a / 2) / a;
+				}
+			} table;
+			return table.values;
+		}
+	}
+
+	/*---------- straight to premultiplied alpha and back ------------*/
+
+	inline void PremultiplyRow(const Pixel* src, Pixel* dst, ui64 count) {
+		ui64 i = 0;
+
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i colorLanes = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+		const __m128i alphaLanes = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+
+			//alpha of each pixel in its 3 color lanes, 255 in the alpha lane so alpha is kept
+			__m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+			__m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+			aLo = _mm_or_si128(_mm_and_si128(aLo, colorLanes), alphaLanes);
+			aHi = _mm_or_si128(_mm_and_si128(aHi, colorLanes), alphaLanes);
+
+			v = _mm_packus_epi16(convert::MulDiv255(lo, aLo), convert::MulDiv255(hi, aHi));
+			_mm_storeu_si128((__m128i*)(dst + i), v);
+		}
+
+		for (; i < count; i++) {
+			const Pixel p = src[i];
+			dst[i] = { convert::MulDiv255(p.r, p.a), convert::MulDiv255(p.g, p.a), convert::MulDiv255(p.b, p.a), p.a };
+		}
+	}
+
+	/*fully transparent pixels come back black, the color they had is lost*/
+	inline void UnpremultiplyRow(const Pixel* src, Pixel* dst, ui64 count) {
+		const ui32* reciprocal = convert::UnpremultiplyTable();
+
+		for (ui64 i = 0; i < count; i++) {
+			const Pixel p = src[i];
+			if (p.a == 255) {
+				dst[i] = p;
+				continue;
+			}
+
+			const ui32 m = reciprocal[p.a];
+			auto channel = [m](ui32 c) { ui32 v = (c * m + 0x8000) >> 16; return ui8(v > 255 ? 255 : v); };
+
+			dst[i] = { channel(p.r), channel(p.g), channel(p.b), p.a };
+		}
+	}
+
+	/*---------- 8 bit grayscale, BT.601 luma weights ------------*/
+
+	inline void ToGray8Row(const Pixel* src, ui8* dst, ui64 count) {
+		ui64 i = 0;
+
+		const __m128i byteMask = _mm_set1_epi32(0xFF);
+		const __m128i wb = _mm_set1_epi32(29), wg = _mm_set1_epi32(150), wr = _mm_set1_epi32(77);
+		const __m128i round = _mm_set1_epi32(128);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+			//every product fits in the low 16 bits of its 32 bit lane
+			__m128i y = _mm_mullo_epi16(_mm_and_si128(v, byteMask), wb);
+			y = _mm_add_epi32(y, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), byteMask), wg));
+			y = _mm_add_epi32(y, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 16), byteMask), wr));
+			y = _mm_srli_epi32(_mm_add_epi32(y, round), 8);
+
+			y = _mm_packus_epi16(_mm_packs_epi32(y, y), y);
+			const int packed = _mm_cvtsi128_si32(y);
+			memcpy(dst + i, &packed, 4);
+		}
+
+		for (; i < count; i++) dst[i] = ui8((src[i].b * 29 + src[i].g * 150 + src[i].r * 77 + 128) >> 8);
+	}
+
+	inline void FromGray8Row(const ui8* src, Pixel* dst, ui64 count) {
+		ui64 i = 0;
+
+		const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+
+		for (; i + 16 <= count; i += 16) {
+			__m128i g = _mm_loadu_si128((const __m128i*)(src + i));
+
+			__m128i lo = _mm_unpacklo_epi8(g, g);
+			__m128i hi = _mm_unpackhi_epi8(g, g);
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_unpacklo_epi16(lo, lo), opaque));
+			_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_or_si128(_mm_unpackhi_epi16(lo, lo), opaque));
+			_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_or_si128(_mm_unpacklo_epi16(hi, hi), opaque));
+			_mm_storeu_si128((__m128i*)(dst + i + 12), _mm_or_si128(_mm_unpackhi_epi16(hi, hi), opaque));
+		}
+
+		for (; i < count; i++) dst[i] = { src[i], src[i], src[i] };
+	}
+
+	/*---------- RGB565, alpha is dropped and comes back opaque ------------*/
+
+	inline void ToRGB565Row(const Pixel* src, ui16* dst, ui64 count) {
+		ui64 i = 0;
+
+		auto pack = [](__m128i v) {
+			__m128i r = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 19), _mm_set1_epi32(0x1F)), 11);
+			__m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 10), _mm_set1_epi32(0x3F)), 5);
+			__m128i b = _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x1F));
+			__m128i c = _mm_or_si128(_mm_or_si128(r, g), b);
+
+			//sign extend so the signed saturating pack keeps all 16 bits
+			return _mm_srai_epi32(_mm_slli_epi32(c, 16), 16);
+		};
+
+		for (; i + 8 <= count; i += 8) {
+			__m128i lo = pack(_mm_loadu_si128((const __m128i*)(src + i)));
+			__m128i hi = pack(_mm_loadu_si128((const __m128i*)(src + i + 4)));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+		}
+
+		for (; i < count; i++) dst[i] = ui16(((src[i].r >> 3) << 11) | ((src[i].g >> 2) << 5) | (src[i].b >> 3));
+	}
+
+	inline void FromRGB565Row(const ui16* src, Pixel* dst, ui64 count) {
+		ui64 i = 0;
+
+		//top bits are repeated in the low ones so 0x1F becomes 0xFF
+		for (; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+
+			__m128i r = _mm_srli_epi16(v, 11);
+			__m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), _mm_set1_epi16(0x3F));
+			__m128i b = _mm_and_si128(v, _mm_set1_epi16(0x1F));
+
+			r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+			g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+			b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+			__m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+			__m128i ra = _mm_or_si128(r, _mm_set1_epi16((short)0xFF00));
+
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+		}
+
+		for (; i < count; i++) {
+			const ui32 r = src[i] >> 11, g = (src[i] >> 5) & 0x3F, b = src[i] & 0x1F;
+			dst[i] = { ui8((r << 3) | (r >> 2)), ui8((g << 2) | (g >> 4)), ui8((b << 3) | (b >> 2)) };
+		}
+	}
+
+	/*---------- screen MapPixel, its fourth byte is always 0 ------------*/
+
+	inline void ToMapPixelRow(const Pixel* src, MapPixel* dst, ui64 count) {
+		ui64 i = 0;
+
+		const __m128i colorMask = _mm_set1_epi32(0x00FFFFFF);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_and_si128(v, colorMask));
+		}
+
+		for (; i < count; i++) dst[i].u = src[i].u & 0x00FFFFFF;
+	}
+
+	inline void FromMapPixelRow(const MapPixel* src, Pixel* dst, ui64 count) {
+		ui64 i = 0;
+
+		const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(v, opaque));
+		}
+
+		for (; i < count; i++) dst[i].u = src[i].u | 0xFF000000;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "utilDefs.h"
+#include "PixelDefs.h"
+#include "Image.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Surface the engine draws on, either the window framebuffer or the pixels of an
+	   Image or ImageView. Rows are addressed from the top like the screen, pitch is the
+	   signed distance between rows in pixels, so bottom-up images get a negative one and
+	   drawing code never needs to know which kind it writes to. Pixel and MapPixel share
+	   their layout, the 4th byte is alpha for targets with alpha and unused otherwise.
+	   Targets with alpha are drawn on as premultiplied, blending keeps the coverage in
+	   alpha so the result composites over anything else afterwards.
+	---------------------------------------------------------------------------------------*/
+
+	class RenderTarget {
+		MapPixel* _top = nullptr;
+		i64 _pitch = 0;
+		int _width = 0;
+		int _height = 0;
+		bool _alpha = false;
+
+	public:
+		RenderTarget() {}
+
+		/*the framebuffer, top row first*/
+		RenderTarget(MapPixel* screen, int w, int h) : _top(screen), _pitch(w), _width(w), _height(h) {}
+
+		RenderTarget(const ImageView& view) :
+			_top(view.empty() ? nullptr : (MapPixel*)view.row(view.height() - 1)),
+			_pitch(-(i64)view.stride()), _width(view.empty() ? 0 : view.width()),
+			_height(view.empty() ? 0 : view.height()), _alpha(view.alpha()) {}
+
+		int width() const { return _width; }
+		int height() const { return _height; }
+		i64 pitch() const { return _pitch; }
+		bool alpha() const { return _alpha; }
+		bool empty() const { return !_top; }
+
+		/*row y counted from the top*/
+		MapPixel* row(int y) const { return _top + y * _pitch; }
+		MapPixel& at(int x, int y) const { return _top[y * _pitch + x]; }
+	};
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <intrin.h>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------- Instruction sets available on the running CPU, SSE2 is always there on x64 ------------*/
+
+	struct CpuFeatures {
+		bool ssse3 = false;
+		bool sse41 = false;
+		bool avx2 = false;
+
+		CpuFeatures() {
+			int info[4];
+
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			bool osAvx = false;
+
+			if (maxLeaf >= 1) {
+				__cpuid(info, 1);
+				ssse3 = (info[2] & (1 << 9)) != 0;
+				sse41 = (info[2] & (1 << 19)) != 0;
+
+				//the OS has to save the ymm registers too
+				if ((info[2] & (1 << 27)) && (info[2] & (1 << 28))) {
+					osAvx = (_xgetbv(0) & 6) == 6;
+				}
+			}
+			if (maxLeaf >= 7) {
+				__cpuidex(info, 7, 0);
+				avx2 = osAvx && (info[1] & (1 << 5)) != 0;
+			}
+		}
+	};
+
+	inline const CpuFeatures& Cpu() {
+		static const CpuFeatures features;
+		return features;
+	}
+}
@@ -70,7 +70,8 @@ namespace voi {
 					if (count > maxLine) maxLine = count;
 					count = 0;
 				}
-				else {
+				else if (((ui8)c & 0xC0) != 0x80) {
+					//UTF-8 continuation bytes do not start a new character
 					count++;
 				}
 			}
@@ -85,6 +86,7 @@ namespace voi {
 		virtual void setBox(Vec4i vec) override {
 			box = vec;
 			calcTextProperties();
+			markMoved();
 		}
 
 		virtual void setPos(int x, int y) override {
@@ -92,17 +94,20 @@ namespace voi {
 			lineX += x - box.x;
 
 			box.x = x; box.y = y;
+			markMoved();
 		}
 
 		virtual void setSize(int x, int y) override {
 			box.z = x; box.w = y;
 			calcTextProperties();
+			markMoved();
 		}
 
 		virtual void setText(std::string nText) {
 			text = nText;
 			if (settedCharH < 0) calcLinesProperties();
 		//TODO:	else calcTextWrap();s
+			markDirty();
 		}
 		
 		void setText(const char* nText) { setText(std::string(nText)); }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <functional>
 
 #include "voiengine.h"
 #include "InteractTextBox.h"
@@ -12,6 +13,13 @@ namespace voi {
 		int displayOffset = 0;
 		int editPos = 0;
 
+		bool caretOn = false;
+		std::function<void()> enterAction;
+
+		void setActive(bool state) {
+			isActive = state;
+			setAnimated(state);
+		}
 
 	public:
 
@@ -38,12 +46,14 @@ namespace voi {
 			box = vec;
 
 			calcDisplayProperties();
+			markMoved();
 		}
 
 		virtual void setSize(int x, int y) override {
 			box.z = x; box.w = y;
 
 			calcDisplayProperties();
+			markMoved();
 		}
 
 		virtual void setText(std::string nText) override {
@@ -56,6 +66,7 @@ namespace voi {
 			{
 				displayOffset = 0;
 			}
+			markDirty();
 		}
 
 		void setText(const char* nText) { setText(std::string(nText)); }
@@ -69,8 +80,15 @@ namespace voi {
 			}
 		}
 
-		void onKeyDown(KeyAccess key) {
+		/*action run on RETURN when the input is owned by a UITree*/
+		void setOnEnter(std::function<void()> action) { enterAction = action; }
+
+		virtual void onMouseClick(MouseAccess key, bool state) override { onClick(state); }
+
+		virtual void onKeyDown(KeyAccess key) override {
 			if (isActive) {
+				markDirty();
+
 				WORD inChar;
 				BYTE kbState[256];
 
@@ -123,6 +141,7 @@ namespace voi {
 					break;
 
 				case voi::RETURN:
+					if (enterAction) enterAction();
 					break;
 
 				default:
@@ -165,17 +184,18 @@ namespace voi {
 
 				backColor = backClickColor;
 				borderColor = borderClickColor;
+				markDirty();
 			}
 			else {
 
 				if (Box::ifOnOver(lastInfo)) {
 					if (isClicked) {
-						isActive = true;
+						setActive(true);
 					}
 				}
 				else {
 					movedIn = false;
-					isActive = false;
+					setActive(false);
 				}
 
 
@@ -193,6 +213,15 @@ namespace voi {
 				backColor = backColorMemory;
 				borderColor = borderColorMemory;
 			}
+			markDirty();
+		}
+
+		virtual void Animate(float totalTime) override {
+			bool blink = (totalTime - int(totalTime)) > 0.5f;
+			if (blink != caretOn) {
+				caretOn = blink;
+				markDirty();
+			}
 		}
 
 		virtual void Draw() override {
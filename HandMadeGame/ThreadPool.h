@@ -0,0 +1,149 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "utilDefs.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Fixed set of worker threads running queued tasks, higher priority first and in
+	   submission order within the same priority. Tasks still queued when the pool is
+	   destroyed are dropped, the running ones are waited for.
+	---------------------------------------------------------------------------------------*/
+
+	class ThreadPool {
+		struct Task {
+			int priority;
+			ui64 order;
+			std::function<void()> work;
+		};
+
+		std::vector<std::thread> workers;
+		std::vector<Task> queue;	// heap, top is the next task to run
+		std::mutex lock;
+		std::condition_variable wake;
+		ui64 submitted = 0;
+		bool stopping = false;
+
+	public:
+		/*threads = 0 uses one worker per core but one, leaving a core to the main loop*/
+		ThreadPool(ui32 threads = 0) {
+			if (!threads) {
+				const ui32 cores = std::thread::hardware_concurrency();
+				threads = cores > 1 ? cores - 1 : 1;
+			}
+
+			for (ui32 i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::Work, this);
+		}
+
+		ThreadPool(const ThreadPool& other) = delete;
+		void operator = (const ThreadPool& other) = delete;
+
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+				queue.clear();
+			}
+			wake.notify_all();
+
+			for (std::thread& worker : workers) worker.join();
+		}
+
+		ui32 size() const { return (ui32)workers.size(); }
+
+		void submit(std::function<void()> work, int priority = 0) {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				queue.push_back({ priority, submitted++, std::move(work) });
+				std::push_heap(queue.begin(), queue.end(), Later);
+			}
+			wake.notify_one();
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   calls func(begin, end) over chunks of [0, count) of about grain items, on the
+		   workers and on the calling thread, and returns once every chunk is done. Helpers
+		   that start after the work ran out only touch the shared counters.
+		-----------------------------------------------------------------------------------*/
+		template<typename F>
+		void parallelFor(int count, int grain, F func) {
+			if (count <= 0) return;
+			if (grain < 1) grain = 1;
+
+			const int chunks = (count + grain - 1) / grain;
+			if (chunks == 1) {
+				func(0, count);
+				return;
+			}
+
+			struct State {
+				std::atomic<int> next{ 0 };
+				std::atomic<int> done{ 0 };
+				std::mutex lock;
+				std::condition_variable finished;
+			};
+			std::shared_ptr<State> state = std::make_shared<State>();
+			F* body = &func;
+
+			auto run = [state, body, chunks, count, grain]() {
+				for (int chunk; (chunk = state->next++) < chunks;) {
+					const int begin = chunk * grain;
+					(*body)(begin, std::min(begin + grain, count));
+
+					if (++state->done == chunks) {
+						std::lock_guard<std::mutex> guard(state->lock);
+						state->finished.notify_all();
+					}
+				}
+			};
+
+			const ui32 helpers = std::min<ui32>(size(), (ui32)chunks - 1);
+			for (ui32 i = 0; i < helpers; i++) submit(run, PARALLEL_PRIORITY);
+
+			run();
+
+			std::unique_lock<std::mutex> guard(state->lock);
+			state->finished.wait(guard, [&] { return state->done == chunks; });
+		}
+
+		//parallelFor helpers go before any queued background task
+		enum : int { PARALLEL_PRIORITY = 1 << 30 };
+
+	private:
+		/*heap order, true when a runs after b*/
+		static bool Later(const Task& a, const Task& b) {
+			return a.priority < b.priority || (a.priority == b.priority && a.order > b.order);
+		}
+
+		void Work() {
+			for (;;) {
+				std::function<void()> work;
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					wake.wait(guard, [this] { return stopping || !queue.empty(); });
+					if (stopping) return;
+
+					std::pop_heap(queue.begin(), queue.end(), Later);
+					work = std::move(queue.back().work);
+					queue.pop_back();
+				}
+				work();
+			}
+		}
+	};
+
+	/*pool shared by the engine's data parallel kernels, started on first use*/
+	inline ThreadPool& SharedPool() {
+		static ThreadPool pool;
+		return pool;
+	}
+}
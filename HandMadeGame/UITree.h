@@ -0,0 +1,366 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "utilDefs.h"
+#include "LinearAlg.h"
+#include "voiengine.h"
+#include "Box.h"
+
+namespace voi {
+
+	/*---------------------------------------------------------------------------------------
+	   Retained widget container: owns its widgets, keeps what they drew on the screen and
+	   only repaints the regions of the widgets that marked themselves dirty since the last
+	   Render. Opaque widgets keep a copy of their pixels so repainting a region under or
+	   over them does not run their Draw again. Widgets are drawn in insertion order, the
+	   last one added is the top-most.
+
+	   Widget bounds are kept in a uniform grid so mouse events only test the widgets of
+	   the cell under the cursor, and hover enter/leave is sent only to the widgets that
+	   gained or lost the cursor.
+
+	   The screen is only written by Render, so the owner engine must not Clear every frame.
+	---------------------------------------------------------------------------------------*/
+
+	class UITree : public WidgetOwner {
+		VoiEngine* engine;
+
+		std::vector<std::unique_ptr<Box>> widgets;
+
+		std::vector<Box*> dirtyList;
+		std::vector<Box*> animatedList;
+		std::vector<Box*> removeList;
+
+		std::vector<Vec4i> damage;
+		bool fullRepaint = true;
+
+		//uniform grid over the screen, each cell lists the widgets overlapping it
+		static const int CELL_SIZE = 64;
+		int gridCols = 0, gridRows = 0;
+		std::vector<std::vector<Box*>> grid;
+		ui32 nextZOrder = 0;
+
+		Box* hovered = nullptr;
+		Box* pressed = nullptr;
+		Box* focused = nullptr;
+		MouseInf lastMouse{};
+		bool hoverStale = false;
+
+		Pixel background{ 255,255,255 };
+
+		//past this many separate damaged rectangles they are merged into their bounding box
+		static const int MAX_DAMAGE_RECTS = 16;
+
+	public:
+		UITree(VoiEngine* engineParam) : engine(engineParam) {}
+
+		UITree(const UITree& other) = delete;
+		void operator = (const UITree& other) = delete;
+
+		/*creates a widget owned by the tree, the reference is valid until it is removed*/
+		template<typename T, typename... Args>
+		T& add(Args&&... args) {
+			T* widget = new T(std::forward<Args>(args)...);
+			widgets.emplace_back(widget);
+
+			widget->attach(engine);
+			widget->owner = this;
+			widget->zOrder = nextZOrder++;
+			widget->dirty = false;
+			widget->markMoved();
+
+			if (widget->animated) animatedList.push_back(widget);
+
+			return *widget;
+		}
+
+		/*the widget is destroyed on the next Render, so it is safe to call from its own events*/
+		void remove(Box& widget) {
+			if (widget.owner != this) return;
+
+			widget.owner = nullptr;
+			removeList.push_back(&widget);
+
+			Unindex(&widget);
+			if (hovered == &widget) hovered = nullptr;
+			if (pressed == &widget) pressed = nullptr;
+			if (focused == &widget) focused = nullptr;
+			hoverStale = true;
+		}
+
+		void setBackground(Pixel color) {
+			background = color;
+			background.a = 255;
+			fullRepaint = true;
+		}
+		Pixel getBackground() const { return background; }
+
+		/*repaints everything on the next Render*/
+		void invalidate() { fullRepaint = true; }
+
+		size_t size() const { return widgets.size(); }
+
+		/*-------- event dispatch --------*/
+
+		void onMouseMove(const MouseInf& info) {
+			lastMouse = info;
+			UpdateHover();
+		}
+
+		/*a press goes to the hovered and the focused widget, so the focused one can notice
+		  it was clicked away from, the release also goes to the widget that got the press*/
+		void onMouseClick(MouseAccess key, bool state) {
+			Box* targets[3] = { hovered, focused, state ? nullptr : pressed };
+
+			for (int i = 0; i < 3; i++) {
+				if (!targets[i] || (i > 0 && targets[i] == targets[0]) || (i > 1 && targets[i] == targets[1])) continue;
+				if (targets[i]->owner == this) targets[i]->onMouseClick(key, state);
+			}
+
+			if (state) {
+				pressed = hovered;
+			}
+			else {
+				focused = pressed;
+				pressed = nullptr;
+			}
+		}
+
+		void onKeyDown(KeyAccess key) {
+			if (focused && focused->owner == this) focused->onKeyDown(key);
+		}
+
+		/*top-most widget whose box contains the point, nullptr if there is none*/
+		Box* widgetAt(int x, int y) {
+			if (x < 0 || y < 0) return nullptr;
+
+			int col = x / CELL_SIZE, row = y / CELL_SIZE;
+			if (col >= gridCols || row >= gridRows) return nullptr;
+
+			Box* top = nullptr;
+			for (Box* widget : grid[row * gridCols + col]) {
+				const Vec4i& b = widget->indexedBox;
+				if (x >= b.x && x < b.x + b.z && y >= b.y && y < b.y + b.w) {
+					if (!top || widget->zOrder > top->zOrder) top = widget;
+				}
+			}
+			return top;
+		}
+
+		/*-------- drawing --------*/
+
+		/*brings the screen up to date, does nothing when no widget changed*/
+		void Render() {
+			if (!removeList.empty()) ApplyRemovals();
+			if (hoverStale) UpdateHover();
+
+			if (!animatedList.empty()) {
+				float time = engine->TotalTime();
+				for (size_t i = 0; i < animatedList.size(); i++) animatedList[i]->Animate(time);
+			}
+
+			if (dirtyList.empty() && damage.empty() && !fullRepaint) return;
+
+			if (fullRepaint) {
+				damage.clear();
+				damage.push_back({ 0, 0, engine->width(), engine->height() });
+			}
+			else {
+				for (Box* widget : dirtyList) {
+					if (widget->drawn) AddDamage(widget->drawnBox);
+					AddDamage(Bounds(*widget));
+				}
+			}
+
+			for (Box* widget : dirtyList) widget->cached = false;
+
+			for (const Vec4i& rect : damage) Repaint(rect);
+
+			for (Box* widget : dirtyList) {
+				widget->dirty = false;
+				widget->drawn = true;
+				widget->drawnBox = Bounds(*widget);
+			}
+
+			dirtyList.clear();
+			damage.clear();
+			fullRepaint = false;
+
+			engine->ResetClip();
+		}
+
+		/*-------- WidgetOwner --------*/
+
+		virtual void onWidgetDirty(Box* widget) override {
+			dirtyList.push_back(widget);
+		}
+
+		virtual void onWidgetMoved(Box* widget) override {
+			Unindex(widget);
+			Index(widget);
+
+			//the widget may have moved under or away from the cursor
+			hoverStale = true;
+		}
+
+		virtual void onWidgetAnimated(Box* widget, bool state) override {
+			if (state) animatedList.push_back(widget);
+			else animatedList.erase(std::remove(animatedList.begin(), animatedList.end(), widget), animatedList.end());
+		}
+
+	private:
+
+		/*screen area touched by Box::Draw, Rect draws its right and bottom sides inclusive*/
+		static Vec4i Bounds(const Box& widget) {
+			Vec4i b = widget.getBox();
+			return { b.x, b.y, b.z + 1, b.w + 1 };
+		}
+
+		static bool Intersects(const Vec4i& a, const Vec4i& b) {
+			return a.x < b.x + b.z && b.x < a.x + a.z && a.y < b.y + b.w && b.y < a.y + a.w;
+		}
+
+		static bool Contains(const Vec4i& outer, const Vec4i& inner) {
+			return inner.x >= outer.x && inner.y >= outer.y &&
+				inner.x + inner.z <= outer.x + outer.z && inner.y + inner.w <= outer.y + outer.w;
+		}
+
+		static Vec4i Union(const Vec4i& a, const Vec4i& b) {
+			int x0 = std::min(a.x, b.x), y0 = std::min(a.y, b.y);
+			int x1 = std::max(a.x + a.z, b.x + b.z), y1 = std::max(a.y + a.w, b.y + b.w);
+			return { x0, y0, x1 - x0, y1 - y0 };
+		}
+
+		void UpdateHover() {
+			hoverStale = false;
+
+			Box* top = widgetAt(lastMouse.pos.x, lastMouse.pos.y);
+			if (top == hovered) return;
+
+			if (hovered) hovered->onMouseLeave(lastMouse);
+			hovered = top;
+			if (hovered) hovered->onMouseEnter(lastMouse);
+		}
+
+		/*-------- spatial grid --------*/
+
+		void EnsureGrid() {
+			int cols = (engine->width() + CELL_SIZE - 1) / CELL_SIZE;
+			int rows = (engine->height() + CELL_SIZE - 1) / CELL_SIZE;
+			if (cols == gridCols && rows == gridRows) return;
+
+			gridCols = cols;
+			gridRows = rows;
+			grid.assign((size_t)cols * rows, {});
+
+			for (auto& widget : widgets) {
+				if (widget->indexed) {
+					widget->indexed = false;
+					Index(widget.get());
+				}
+			}
+		}
+
+		/*calls func on every grid cell the rectangle overlaps, false if it is out of the grid*/
+		template<typename F>
+		bool ForEachCell(const Vec4i& rect, F func) {
+			if (rect.z <= 0 || rect.w <= 0) return false;
+
+			int col0 = std::max(rect.x, 0) / CELL_SIZE, row0 = std::max(rect.y, 0) / CELL_SIZE;
+			int col1 = std::min((rect.x + rect.z - 1) / CELL_SIZE, gridCols - 1);
+			int row1 = std::min((rect.y + rect.w - 1) / CELL_SIZE, gridRows - 1);
+			if (rect.x + rect.z <= 0 || rect.y + rect.w <= 0 || col0 > col1 || row0 > row1) return false;
+
+			for (int row = row0; row <= row1; row++) {
+				for (int col = col0; col <= col1; col++) func(grid[row * gridCols + col]);
+			}
+			return true;
+		}
+
+		void Index(Box* widget) {
+			EnsureGrid();
+
+			widget->indexedBox = Bounds(*widget);
+			widget->indexed = ForEachCell(widget->indexedBox, [&](std::vector<Box*>& cell) { cell.push_back(widget); });
+		}
+
+		void Unindex(Box* widget) {
+			if (!widget->indexed) return;
+
+			ForEachCell(widget->indexedBox, [&](std::vector<Box*>& cell) {
+				cell.erase(std::remove(cell.begin(), cell.end(), widget), cell.end());
+			});
+			widget->indexed = false;
+		}
+
+		void AddDamage(Vec4i rect) {
+			if (rect.z <= 0 || rect.w <= 0) return;
+
+			//merge with every overlapping rect so no pixel gets repainted twice
+			for (size_t i = 0; i < damage.size();) {
+				if (Intersects(damage[i], rect)) {
+					rect = Union(damage[i], rect);
+					damage[i] = damage.back();
+					damage.pop_back();
+					i = 0;
+				}
+				else {
+					i++;
+				}
+			}
+
+			damage.push_back(rect);
+
+			if (damage.size() > MAX_DAMAGE_RECTS) {
+				Vec4i all = damage[0];
+				for (const Vec4i& r : damage) all = Union(all, r);
+				damage.clear();
+				damage.push_back(all);
+			}
+		}
+
+		void Repaint(const Vec4i& rect) {
+			engine->SetClip(rect);
+
+			engine->colorSet = background;
+			engine->FillRect(rect.x, rect.y, rect.z, rect.w);
+
+			for (auto& widget : widgets) {
+				Vec4i bounds = Bounds(*widget);
+				if (!Intersects(bounds, rect)) continue;
+
+				if (widget->cached) {
+					engine->PasteImage(widget->cache, bounds.x, bounds.y);
+					continue;
+				}
+
+				widget->Draw();
+
+				//the whole widget was just drawn over fresh pixels, keep them if nothing under it shows through
+				if (widget->isOpaque() && Contains(rect, bounds)) {
+					if (widget->cache.width() != bounds.z || widget->cache.height() != bounds.w) {
+						widget->cache = Image(bounds.z, bounds.w);
+					}
+					engine->CopyRegion(widget->cache, bounds.x, bounds.y);
+					widget->cached = true;
+				}
+			}
+		}
+
+		void ApplyRemovals() {
+			for (Box* widget : removeList) {
+				if (widget->drawn) AddDamage(widget->drawnBox);
+
+				dirtyList.erase(std::remove(dirtyList.begin(), dirtyList.end(), widget), dirtyList.end());
+				animatedList.erase(std::remove(animatedList.begin(), animatedList.end(), widget), animatedList.end());
+
+				widgets.erase(std::remove_if(widgets.begin(), widgets.end(),
+					[&](const std::unique_ptr<Box>& w) { return w.get() == widget; }), widgets.end());
+			}
+			removeList.clear();
+		}
+	};
+}
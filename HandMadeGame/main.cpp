@@ -16,6 +16,7 @@
 #include "Box.h"
 #include "Button.h"
 #include "TextInput.h"
+#include "UITree.h"
 
 class Testing : public voi::VoiEngine {
 
@@ -23,53 +24,53 @@ class Testing : public voi::VoiEngine {
 
 	int charW;
 	int charH = 20;
-	voi::TextInput Input;
 
-	voi::Button button;
+	voi::UITree ui{ this };
 
-	voi::TextBox text;
+	voi::TextInput* Input;
+
+	voi::Button* button;
+
+	voi::TextBox* text;
 
 	void OnCreate() override {
 		clearColor = { 255,255,255 };
+		ui.setBackground(clearColor);
 
 		charW = CharWidth(charH);
 
-		Input.attach(this);
-		Input.setBox(20, 20, 550, 90);
-		Input.setBorderColor({ 128,128,128 });
-		Input.setBackOverColor({ 240,240,240 });
-		Input.setBorderOverColor({ 128,128,128 });
-		Input.setBackClickColor({ 240,240,240 });
+		Input = &ui.add<voi::TextInput>();
+		Input->setBox(20, 20, 550, 90);
+		Input->setBorderColor({ 128,128,128 });
+		Input->setBackOverColor({ 240,240,240 });
+		Input->setBorderOverColor({ 128,128,128 });
+		Input->setBackClickColor({ 240,240,240 });
 
-		button.attach(this);
-		button.setBox(590, 20, 250, 90);
-		button.setText("set Input to default");
+		button = &ui.add<voi::Button>();
+		button->setBox(590, 20, 250, 90);
+		button->setText("set Input to default");
 
-		text.attach(this);
-		text.setBox(20, 130, 550, 360);
+		text = &ui.add<voi::TextBox>();
+		text->setBox(20, 130, 550, 360);
+
+		button->setOnClick([this]() { Input->setText(""); });
+		Input->setOnEnter([this]() { text->setText(Input->getText()); });
 	}
 
 	void OnUpdate(float deltaTime) override {
-		Clear();
-
-		Input.Draw();
-		button.Draw();
-		text.Draw();
+		ui.Render();
 	}
 
 	void OnMouseMove(voi::MouseInf inf) override {
-		Input.ifOnOver(inf);
-		button.ifOnOver(inf);
+		ui.onMouseMove(inf);
 	}
 
 	void OnMouseClick(voi::MouseAccess key, bool state) override {
-		Input.onClick(state);
-		button.onClick(state, [&](){ Input.setText(""); });
+		ui.onMouseClick(key, state);
 	}
 
 	void OnKeyDown(voi::KeyAccess key) override {
-		Input.onKeyDown(key);
-		Input.onEnter(key, [&]() { text.setText(Input.getText()); });
+		ui.onKeyDown(key);
 	}
 
 };
@@ -15,6 +15,11 @@
 #include "LinearAlg.h"
 #include "PixelDefs.h"
 #include "Image.h"
+#include "Font.h"
+#include "EventQueue.h"
+#include "AssetLoader.h"
+#include "FrameCapture.h"
+#include "RenderTarget.h"
 
 namespace voi{
 
@@ -38,6 +43,14 @@ namespace voi{
 
 	struct Dimension { int w; int h; };
 
+	/*---------- Input message queued by the window procedure for the render loop ------------*/
+	struct InputEvent {
+		enum Type : ui8 { KEY_DOWN, KEY_UP, MOUSE_DOWN, MOUSE_UP, MOUSE_MOVE, MOUSE_WHEEL } type;
+		ui8 key;
+		i32 x, y;	//mouse position, x holds the delta for MOUSE_WHEEL
+		std::chrono::steady_clock::time_point time;
+	};
+
 	typedef enum : ui8 {
 		VK_LMB = 0x01, VK_RMB, CANCEL, VK_MMB, VK_X1MB, VK_X2MB, BACK = 0x08, TAB, CLEAR = 0x0C, RETURN, SHIFT = 0x10, CTRL, ALT, PAUSE, CAPS_LOCK,
 		KANA, IME_ON, JUNJA, FINAL, KANJI, IME_OFF, ESC, CONVERT, NONCONVERT, ACCEPT, MODECHANGE, SPACE, PAGE_UP, PAGE_DOWN, END,
@@ -984,6 +997,10 @@ namespace voi{
 		ui8 keyState[254] = { 0 };
 		MouseInf mouseState;
 
+		//filled by WinProc, drained once per frame by the render loop
+		SPSCQueue<InputEvent, 1024> inputQueue;
+		std::chrono::steady_clock::time_point eventTime;
+
 		static WindowHandler* ownHandle;
 
 		WindowHandler() {}
@@ -1132,6 +1149,50 @@ namespace voi{
 			return result;
 		};
 
+		std::chrono::steady_clock::time_point EventTimeConsult() const {
+			return eventTime;
+		}
+
+		/*---------- Applies the queued input to the key and mouse state, firing the input events ------------*/
+		void DrainInput() {
+			InputEvent e;
+
+			while (inputQueue.pop(e)) {
+				eventTime = e.time;
+
+				switch (e.type) {
+				case InputEvent::KEY_DOWN:
+					KeyDownCall((KeyAccess)e.key);
+					break;
+				case InputEvent::KEY_UP:
+					KeyUpCall((KeyAccess)e.key);
+					break;
+				case InputEvent::MOUSE_DOWN:
+					MouseDownCall((MouseAccess)e.key);
+					OnMouseClick((MouseAccess)e.key, true);
+					break;
+				case InputEvent::MOUSE_UP:
+					MouseUpCall((MouseAccess)e.key);
+					OnMouseClick((MouseAccess)e.key, false);
+					break;
+				case InputEvent::MOUSE_MOVE: {
+					//consecutive moves collapse into the last one, dPos still spans all of them
+					const InputEvent* next;
+					while ((next = inputQueue.front()) && next->type == InputEvent::MOUSE_MOVE) {
+						e = *next;
+						inputQueue.pop();
+					}
+					eventTime = e.time;
+
+					MouseMoveCall(e.x, e.y);
+				}break;
+				case InputEvent::MOUSE_WHEEL:
+					MouseWheelCall(e.x);
+					break;
+				}
+			}
+		}
+
 	private:
 
 		/*---------- Gets client dimension { width, height } of given window handle ------------*/
@@ -1150,6 +1211,11 @@ namespace voi{
 			return { cr.right - cr.left, cr.bottom - cr.top };
 		}
 
+		/*---------- Queues an input message, dropped if the render loop fell 1024 messages behind ------------*/
+		void PushInput(InputEvent::Type type, ui8 key, i32 x = 0, i32 y = 0) {
+			inputQueue.push({ type, key, x, y, std::chrono::steady_clock::now() });
+		}
+
 		/*---------- Calls the KeyUp event function after locking the thread ------------*/
 		void KeyUpCall(KeyAccess key) {
 			keyState[key] &= 0xfe;
@@ -1282,34 +1348,28 @@ namespace voi{
 				/*------------------- Mouse Messages Handle ------------------*/
 
 			case WM_LBUTTONDOWN: {
-				ownHandle->MouseDownCall(LMB);
-				ownHandle->OnMouseClick(LMB, true);
+				ownHandle->PushInput(InputEvent::MOUSE_DOWN, LMB);
 			}break;
 			case WM_LBUTTONUP: {
-				ownHandle->MouseUpCall(LMB);
-				ownHandle->OnMouseClick(LMB, false);
+				ownHandle->PushInput(InputEvent::MOUSE_UP, LMB);
 			}break;
 
 			case WM_RBUTTONDOWN: {
-				ownHandle->MouseDownCall(RMB);
-				ownHandle->OnMouseClick(RMB, true);
+				ownHandle->PushInput(InputEvent::MOUSE_DOWN, RMB);
 			}break;
 			case WM_RBUTTONUP: {
-				ownHandle->MouseUpCall(RMB);
-				ownHandle->OnMouseClick(RMB, false);
+				ownHandle->PushInput(InputEvent::MOUSE_UP, RMB);
 			}break;
 
 			case WM_MBUTTONDOWN: {
-				ownHandle->MouseDownCall(MMB);
-				ownHandle->OnMouseClick(MMB, true);
+				ownHandle->PushInput(InputEvent::MOUSE_DOWN, MMB);
 			}break;
 			case WM_MBUTTONUP: {
-				ownHandle->MouseUpCall(MMB);
-				ownHandle->OnMouseClick(MMB, false);
+				ownHandle->PushInput(InputEvent::MOUSE_UP, MMB);
 			}break;
 
 			case WM_MOUSEMOVE: {
-				ownHandle->MouseMoveCall(
+				ownHandle->PushInput(InputEvent::MOUSE_MOVE, 0,
 					(0xFFFF & lParam) / ownHandle->_xScale,
 					((lParam >> 16) & 0xFFFF) / ownHandle->_yScale
 				);
@@ -1317,7 +1377,7 @@ namespace voi{
 			case WM_MOUSEWHEEL: {
 				short dw = (wParam >> 16) & 0xFFFF;
 
-				ownHandle->MouseWheelCall(dw);
+				ownHandle->PushInput(InputEvent::MOUSE_WHEEL, 0, dw);
 			}break;
 
 				/*------------------- Key Messages Handle ------------------*/
@@ -1325,12 +1385,12 @@ namespace voi{
 			case WM_SYSKEYDOWN:
 			case WM_KEYDOWN: {
 				ui8 key = 0xFF & wParam;
-				ownHandle->KeyDownCall((KeyAccess)key);
+				ownHandle->PushInput(InputEvent::KEY_DOWN, key);
 			}break;
 			case WM_SYSKEYUP:
 			case WM_KEYUP: {
 				ui8 key = 0xFF & wParam;
-				ownHandle->KeyUpCall((KeyAccess)key);
+				ownHandle->PushInput(InputEvent::KEY_UP, key);
 			}break;
 
 				/*------------------- Default Messages Handle ------------------*/
@@ -1356,13 +1416,21 @@ namespace voi{
 		MapPixel* pixelBuffer;
 		ui64 _frameCount = 0;
 
+		//what drawing functions write to, the screen unless SetRenderTarget chose an image
+		RenderTarget target;
+
+		//drawing only touches pixels inside [clipX0, clipX1) x [clipY0, clipY1)
+		int clipX0 = 0, clipY0 = 0, clipX1 = 0, clipY1 = 0;
+
 		XINPUT_STATE _padState{ 0 };
 		bool _padConnected = false;
 
-		Image font;
-		int fontW, fontH, charsXWidth;
+		Font font;
 		float fontWHratio;
 
+		std::unique_ptr<AssetLoader> assets;
+		std::unique_ptr<FrameCapture> capture;
+
 	public:
 
 		Pixel colorSet{ 0xFF, 0xFF, 0xFF };
@@ -1377,25 +1445,13 @@ namespace voi{
 
 		bool Construct(HINSTANCE instance, const wchar_t* name, ui32 w, ui32 h, ui32 wSize = 1, ui32 hSize = 1) {
 
-			font = voi::Image::ReadDecodeImage("consolas_font_mid_res.bmp");
-			Pixel black = { 0,0,0 };
-
-			for (int y = 0; y < font.height(); y++) {
-				if (font.data()[y * font.width() + (font.width() - 1)].u != black.u) {
-					fontH = y;
-					break;
-				}
-			}
-
-			for (int x = font.width() - 1; x >= 0; x--) {
-				if (font.data()[x].u != black.u) {
-					fontW = font.width() - x - 1;
-					break;
-				}
+			//the .vfnt is made offline from the grid bitmap with Font::ConvertGrid and shipped next to it,
+			//without it the bitmap is sliced on every start. Nothing is written from here
+			if (!font.Load("consolas_font_mid_res.vfnt")) {
+				font = Font::FromGrid(Image::ReadDecodeImage("consolas_font_mid_res.bmp"));
 			}
 
-			charsXWidth = font.width() / fontW;
-			fontWHratio = (float)fontW / (float)fontH;
+			fontWHratio = font.lineHeight() ? (float)font.maxAdvance() / (float)font.lineHeight() : 1.f;
 
 			return this->WindowHandler::Construct(instance, name, w, h, wSize, hSize);
 		}
@@ -1458,6 +1514,11 @@ namespace voi{
 			return MouseWheelConsult();
 		}
 
+		/*arrival time of the input message being handled, valid inside the key and mouse events*/
+		std::chrono::steady_clock::time_point EventTime() {
+			return EventTimeConsult();
+		}
+
 		/*-----------------------------------------------------------------------*/
 
 						/*##################################*/
@@ -1499,11 +1560,41 @@ namespace voi{
 		int width() { return buffInf.width; }
 		int height() { return buffInf.height; }
 
-		int CharWidth(int height) { return int(height * fontWHratio); }
+		int CharWidth(int height) { return int(font.maxAdvance() * FontScale(height)); }
 		int CharHeight(int width) { return round(width / fontWHratio); }
 
-		int FontWidth() { return fontW; }
-		int FontHeight() { return fontH; }
+		int FontWidth() { return font.maxAdvance(); }
+		int FontHeight() { return font.lineHeight(); }
+
+		/*width in pixels of the widest line of the string drawn with the given height*/
+		int StringWidth(const char* str, int height) {
+			const float scale = FontScale(height);
+			int lineX = 0, maxX = 0;
+			ui16 prev = Font::NO_GLYPH;
+
+			while (*str != '\0') {
+				if (*str == '\n') {
+					lineX = 0;
+					prev = Font::NO_GLYPH;
+					str++;
+					continue;
+				}
+
+				ui16 index = font.glyphIndex(NextCodepoint(str));
+				if (index == Font::NO_GLYPH) {
+					lineX += int(font.maxAdvance() * scale);
+				}
+				else {
+					if (prev != Font::NO_GLYPH) lineX += int(font.kerning(prev, index) * scale);
+					lineX += int(font.glyph(index).advance * scale);
+				}
+				prev = index;
+
+				if (lineX > maxX) maxX = lineX;
+			}
+
+			return maxX;
+		}
 
 		float FontWHRatio() { return fontWHratio; }
 
@@ -1513,11 +1604,17 @@ namespace voi{
 
 		float TotalTime() { return totalTime; }
 
+		/*background image loader, started on first use, its loads complete right before OnUpdate*/
+		AssetLoader& Assets() {
+			if (!assets) assets.reset(new AssetLoader());
+			return *assets;
+		}
+
 		Pixel GetPixel(int x, int y) {
 			Pixel res;
 
-			if (x < buffInf.width && x >= 0 && y < buffInf.height && y >= 0) {
-				res = pixelBuffer[y * buffInf.width + x];
+			if (x < target.width() && x >= 0 && y < target.height() && y >= 0) {
+				res = target.at(x, y);
 			}
 
 			return res;
@@ -1534,6 +1631,69 @@ namespace voi{
 		void SetBackground(ui8 r, ui8 g, ui8 b) { clearColor = { r,g,b }; }
 		void SetBackground(Pixel pixel) { clearColor = { pixel }; }
 
+		/*restricts every drawing function to the given rectangle, clamped to the render target*/
+		void SetClip(int x, int y, int w, int h) {
+			clipX0 = clamp(x, 0, target.width());
+			clipY0 = clamp(y, 0, target.height());
+			clipX1 = clamp(x + w, clipX0, target.width());
+			clipY1 = clamp(y + h, clipY0, target.height());
+		}
+		void SetClip(const Vec4i& rect) { SetClip(rect.x, rect.y, rect.z, rect.w); }
+
+		void ResetClip() { SetClip(0, 0, target.width(), target.height()); }
+
+		Vec4i GetClip() const { return { clipX0, clipY0, clipX1 - clipX0, clipY1 - clipY0 }; }
+
+		/*-----------------------------------------------------------------------------------
+		   every drawing function renders into img until ResetRenderTarget, coordinates are
+		   then measured from its top-left corner and the clip covers all of it. Images with
+		   alpha are premultiplied first, what is drawn keeps its coverage in alpha, so the
+		   result can be drawn over the screen later with DrawImage. img has to stay alive
+		   and keep its size while it is the target
+		-----------------------------------------------------------------------------------*/
+		void SetRenderTarget(Image& img) {
+			if (img.alpha()) img.Premultiply();
+			SetRenderTarget(img.view());
+		}
+		/*views with alpha are taken as premultiplied*/
+		void SetRenderTarget(const ImageView& view) {
+			target = RenderTarget(view);
+			ResetClip();
+		}
+
+		/*back to drawing on the screen, the clip is reset to all of it*/
+		void ResetRenderTarget() {
+			target = RenderTarget(pixelBuffer, buffInf.width, buffInf.height);
+			ResetClip();
+		}
+
+		const RenderTarget& GetRenderTarget() const { return target; }
+
+		/*writes every Nth frame to prefix + frame number + .qoi (or .bmp) on a background thread*/
+		void StartCapture(const char* prefix, ui32 everyN = 1, bool qoi = true) {
+			capture.reset();
+			capture.reset(new FrameCapture(prefix, everyN, qoi));
+		}
+
+		/*waits for the frames still being written*/
+		void StopCapture() { capture.reset(); }
+
+		bool Capturing() { return capture != nullptr; }
+
+		/*writes the screen as it is now to a .bmp or .qoi file*/
+		bool SaveScreen(const char* path) {
+			std::string extension(path);
+			if (extension.size() < 3) return false;
+			extension = extension.substr(extension.size() - 3, 3);
+
+			std::vector<ui8> data;
+			if (!extension.compare("bmp")) EncodeBMP(pixelBuffer, buffInf.width, buffInf.height, data);
+			else if (!extension.compare("qoi")) EncodeQOI(pixelBuffer, buffInf.width, buffInf.height, data);
+			else return false;
+
+			return WriteFileData(path, data);
+		}
+
 		/*-----------------------------------------------------------------------*/
 
 						/*##################################*/
@@ -1542,34 +1702,52 @@ namespace voi{
 
 		/*-----------------------------------------------------------------------*/
 
-		/*sets entire screen to clear color*/
+		/*sets entire render target to clear color, targets with alpha are cleared to transparent*/
 		void Clear() {
-			//TODO: profile performance diference
-			//std::fill(pixelBuffer, pixelBuffer + (buffInf.width * buffInf.height) - 1, clearColor);
-			for (int i = 0; i < buffInf.width * buffInf.height; i++) {
-				pixelBuffer[i] = clearColor;
-			}
+			Fill(target.alpha() ? MapPixel() : clearColor);
+		}
+		/*sets entire render target to color, premultiplied on targets with alpha*/
+		void Clear(Pixel color) {
+			if (target.alpha()) PremultiplyRow(&color, &color, 1);
+			else color.a = 0;
+			Fill(color);
 		}
 		/*sets the pxel color at coordinate x, y*/
 		void SetPixel(int x, int y, ui8 r, ui8 g, ui8 b) {
-			if (x < buffInf.width && x >= 0 && y < buffInf.height && y >= 0) {
-				pixelBuffer[y * buffInf.width + x].SetColor(r, g, b);
+			if (x < clipX1 && x >= clipX0 && y < clipY1 && y >= clipY0) {
+				MapPixel& p = target.at(x, y);
+				p.SetColor(r, g, b);
+				if (target.alpha()) p.x = 255;
 			}
 		}
 
 		/*writes a point in coordinates x, y*/
 		void Point(int x, int y) {
-			if (x < buffInf.width && x >= 0 && y < buffInf.height && y >= 0) {
-				MapPixel* p = &(pixelBuffer[y * buffInf.width + x]);
+			if (x < clipX1 && x >= clipX0 && y < clipY1 && y >= clipY0) {
+				MapPixel* p = &target.at(x, y);
 
 				p->r = (p->r * 256 + (colorSet.r - p->r) * colorSet.a) >> 8;
 				p->b = (p->b * 256 + (colorSet.b - p->b) * colorSet.a) >> 8;
 				p->g = (p->g * 256 + (colorSet.g - p->g) * colorSet.a) >> 8;
+				if (target.alpha()) p->x = (p->x * 256 + (255 - p->x) * colorSet.a) >> 8;
 
 				//pixelBuffer[y * buffInf.width + x].SetColor(colorSet.r, colorSet.g, colorSet.b);
 			}
 		}
 
+		/*like Point but colorSet is premultiplied, its color is already scaled by its alpha*/
+		void PointPremultiplied(int x, int y) {
+			if (x < clipX1 && x >= clipX0 && y < clipY1 && y >= clipY0) {
+				MapPixel* p = &target.at(x, y);
+				const int keep = 256 - colorSet.a;
+
+				p->r = colorSet.r + ((p->r * keep) >> 8);
+				p->b = colorSet.b + ((p->b * keep) >> 8);
+				p->g = colorSet.g + ((p->g * keep) >> 8);
+				if (target.alpha()) p->x = colorSet.a + ((p->x * keep) >> 8);
+			}
+		}
+
 		void Point(Vec2i& pos) {
 			Point(pos.x, pos.y);
 		}
@@ -1826,16 +2004,16 @@ namespace voi{
 			FillCircle(pos.x, pos.y, r);
 		}
 
-		void DrawImage(const Image& img, int x, int y) {
+		void DrawImage(const ImageView& img, int x, int y) {
 			for (int imgY = img.height() - 1; imgY >= 0; imgY--) {
 				for (int imgX = 0; imgX < img.width(); imgX++) {
-					colorSet = img.data()[imgY * img.width() + imgX];
-					Point(x + imgX, y + (img.height() - imgY) - 1);
+					colorSet = img.row(imgY)[imgX];
+					ImagePoint(img, x + imgX, y + (img.height() - imgY) - 1);
 				}
 			}
 		}
 
-		void DrawImage(const Image& img, int x, int y, int w, int h) {
+		void DrawImage(const ImageView& img, int x, int y, int w, int h) {
 
 			if (w == 0 || h == 0) return;
 
@@ -1853,9 +2031,9 @@ namespace voi{
 					float finalX = xStep >= img.width()? (img.width() -1): xStep;
 					float finalY = yStep >= img.height()? (img.height() - 1): yStep;
 
-					colorSet = img.data()[int(img.height() - 1 - finalY) * img.width() + int(finalX)];
+					colorSet = img.row(int(img.height() - 1 - finalY))[int(finalX)];
 
-					Point(x + xOff, y + yOff);
+					ImagePoint(img, x + xOff, y + yOff);
 
 					xOff++;
 				}
@@ -1864,7 +2042,7 @@ namespace voi{
 			}
 		}
 
-		void DrawPartialImage(const Image& img, int x, int y, int w, int h, int s, int t, int tW, int tH) {
+		void DrawPartialImage(const ImageView& img, int x, int y, int w, int h, int s, int t, int tW, int tH) {
 			if (w == 0 || h == 0 || tW == 0 || tH == 0) return;
 			s = clamp(s, 0, img.width() - 1);
 			t = clamp(t, 0, img.height() - 1);
@@ -1887,9 +2065,9 @@ namespace voi{
 					float finalX = xStep >= img.width() ? (img.width() - 1) : xStep;
 					float finalY = yStep >= img.height() ? (img.height() - 1) : yStep;
 
-					colorSet = img.data()[int(img.height() - 1 - finalY) * img.width() + int(finalX)];
+					colorSet = img.row(int(img.height() - 1 - finalY))[int(finalX)];
 
-					Point(x + xOff, y + yOff);
+					ImagePoint(img, x + xOff, y + yOff);
 
 					xOff++;
 				}
@@ -1899,34 +2077,83 @@ namespace voi{
 		}
 
 		void DrawString(const char* str, int x, int y, int height, Pixel color = { 0,0,0,0 }) {
+			const float scale = FontScale(height);
 			int lineX = x;
-			int width = (int)(height * fontWHratio);
+			ui16 prev = Font::NO_GLYPH;
 
 			color.a = 0;
 
-			for (int i = 0; str[i] != '\0'; i++) {
-				if (str[i] == '\n') {
+			while (*str != '\0') {
+				if (*str == '\n') {
 					y += height;
 					lineX = x;
+					prev = Font::NO_GLYPH;
+					str++;
+					continue;
 				}
-				else if (str[i] >= 32 && str[i] < 127) {
 
-					DrawPartialMaskedFontImage(font, lineX, y, width, height,
-						((str[i] - 32) % charsXWidth) * fontW,
-						((str[i] - 32) / charsXWidth) * fontH + 1, 
-						fontW, fontH - 2,
+				//ASCII stays a single table load, anything else goes through the UTF-8 decoder
+				ui16 index = ((ui8)*str < 0x80) ? font.glyphIndex((ui8)*str++) : font.glyphIndex(NextCodepoint(str));
+				if (index == Font::NO_GLYPH) {
+					lineX += int(font.maxAdvance() * scale);
+					prev = index;
+					continue;
+				}
+
+				const FontGlyph& g = font.glyph(index);
+				if (prev != Font::NO_GLYPH) lineX += int(font.kerning(prev, index) * scale);
+
+				if (g.w && g.h) {
+					DrawPartialMaskedFontImage(font.atlas(),
+						lineX + int(g.bearingX * scale), y + int(g.bearingY * scale),
+						int(g.w * scale + 0.5f), int(g.h * scale + 0.5f),
+						g.s, g.t, g.w, g.h,
 						color
 					);
+				}
 
-					lineX += width;
+				lineX += int(g.advance * scale);
+				prev = index;
+			}
+		}
+
+		/*-----------------------------------------------------------------------------------
+		   copies the render target pixels at x, y into dst, as many as fit in dst. A target
+		   with alpha gives its coverage along, the screen's 4th byte is unused and reads as
+		   opaque
+		-----------------------------------------------------------------------------------*/
+		void CopyRegion(const ImageView& dst, int x, int y) {
+			const int x0 = clamp(x, 0, target.width()), x1 = clamp(x + dst.width(), x0, target.width());
+			const int y0 = clamp(y, 0, target.height()), y1 = clamp(y + dst.height(), y0, target.height());
+			const bool keepAlpha = target.alpha();
+
+			for (int sy = y0; sy < y1; sy++) {
+				Pixel* row = dst.row(dst.height() - 1 - (sy - y)) - x;
+				const MapPixel* src = target.row(sy);
+				if (keepAlpha) {
+					for (int sx = x0; sx < x1; sx++) row[sx].u = src[sx].u;
 				}
 				else {
-					lineX += width;
+					for (int sx = x0; sx < x1; sx++) row[sx] = src[sx];
+				}
+			}
+		}
+
+		/*writes img at x, y as is, without scaling or blending, inside the clip rectangle*/
+		void PasteImage(const ImageView& img, int x, int y) {
+			const int x0 = clamp(x, clipX0, clipX1), x1 = clamp(x + img.width(), x0, clipX1);
+			const int y0 = clamp(y, clipY0, clipY1), y1 = clamp(y + img.height(), y0, clipY1);
+
+			for (int dy = y0; dy < y1; dy++) {
+				const Pixel* row = img.row(img.height() - 1 - (dy - y)) - x;
+				MapPixel* dst = target.row(dy);
+				for (int dx = x0; dx < x1; dx++) {
+					dst[dx] = row[dx];
 				}
 			}
 		}
 
-		void DrawTexture(const voi::Image& img, int x, int y, int w, int h, float s, float t, float p, float q, voi::Pixel blanking = { 0,0,0 }, ui16 info = 0) {
+		void DrawTexture(const voi::ImageView& img, int x, int y, int w, int h, float s, float t, float p, float q, voi::Pixel blanking = { 0,0,0 }, ui16 info = 0) {
 
 			if (w == 0 || h == 0 || s - p == 0 || t - q == 0) return;
 
@@ -1950,7 +2177,7 @@ namespace voi{
 
 					colorSet = GetTexColor(img, xStep, 1.0f - yStep, info);
 
-					Point(x + xOff, y + yOff);
+					ImagePoint(img, x + xOff, y + yOff);
 
 					xStep += xFac;
 				}
@@ -1962,6 +2189,16 @@ namespace voi{
 
 	private:
 
+		float FontScale(int height) {
+			return font.lineHeight() ? (float)height / (float)font.lineHeight() : 0.f;
+		}
+
+		void Fill(MapPixel color) {
+			for (int y = 0; y < target.height(); y++) {
+				std::fill(target.row(y), target.row(y) + target.width(), color);
+			}
+		}
+
 		template<typename T>
 		T clamp(T a, T min, T max) {
 			if (a < min) return min;
@@ -2039,7 +2276,7 @@ namespace voi{
 			Point(-yc + x, -xc + y);
 		}
 
-		void DrawPartialMaskedFontImage(const Image& img, int x, int y, int w, int h, int s, int t, int tW, int tH, Pixel color) {
+		void DrawPartialMaskedFontImage(const ImageView& img, int x, int y, int w, int h, int s, int t, int tW, int tH, Pixel color) {
 			if (w == 0 || h == 0 || tW == 0 || tH == 0) return;
 			s = clamp(s, 0, img.width() - 1);
 			t = clamp(t, 0, img.height() - 1);
@@ -2062,7 +2299,7 @@ namespace voi{
 					float finalX = xStep >= img.width() ? (img.width() - 1) : xStep;
 					float finalY = yStep >= img.height() ? (img.height() - 1) : yStep;
 
-					colorSet.u = img.data()[int(img.height() - 1 - finalY) * img.width() + int(finalX)].u | color.u;
+					colorSet.u = img.row(int(img.height() - 1 - finalY))[int(finalX)].u | color.u;
 
 					Point(x + xOff, y + yOff);
 
@@ -2072,11 +2309,11 @@ namespace voi{
 				yOff++;
 			}
 
-			//colorSet.u = img.data()[(int)imgY * img.width() + (int)imgX].u | color.u;
+			//colorSet.u = img.row((int)imgY)[(int)imgX].u | color.u;
 
 		}
 
-		voi::Pixel GetTexColor(const voi::Image& img, float x, float y, ui16 info) {
+		voi::Pixel GetTexColor(const voi::ImageView& img, float x, float y, ui16 info) {
 
 			switch (info & 0xFF) {
 				//blank
@@ -2136,14 +2373,14 @@ namespace voi{
 			}
 		}
 
-		voi::Pixel GetInternalColor(const voi::Image& img, float x, float y, ui16 info) {
+		voi::Pixel GetInternalColor(const voi::ImageView& img, float x, float y, ui16 info) {
 
 			switch ((info >> 8) & 0xFF) {
 			case 0:
 				if (x > (img.width() - 1)) x = img.width() - 1;
 				if (y > (img.height() - 1)) y = img.height() - 1;
 
-				return img.data()[int(y) * img.width() + int(x)];
+				return img.row(int(y))[int(x)];
 			case 1: {
 
 				x -= 0.5f;
@@ -2161,28 +2398,38 @@ namespace voi{
 				float xT = x - xFloor;
 				float yT = y - yFloor;
 
-				voi::Pixel yFloorPix = BLAlphaCorrectLerp(
-					img.data()[int(yFloor) * img.width() + int(xFloor)],
-					img.data()[int(yFloor) * img.width() + int(xCeil)],
+				voi::Pixel yFloorPix = TexelLerp(img,
+					img.row(int(yFloor))[int(xFloor)],
+					img.row(int(yFloor))[int(xCeil)],
 					xT
 				);
 
-				voi::Pixel yCeilPix = BLAlphaCorrectLerp(
-					img.data()[int(yCeil) * img.width() + int(xFloor)],
-					img.data()[int(yCeil) * img.width() + int(xCeil)],
+				voi::Pixel yCeilPix = TexelLerp(img,
+					img.row(int(yCeil))[int(xFloor)],
+					img.row(int(yCeil))[int(xCeil)],
 					xT
 				);
 
-				return  BLAlphaCorrectLerp(yFloorPix, yCeilPix, yT);
+				return TexelLerp(img, yFloorPix, yCeilPix, yT);
 			}
 			default:
 				if (x > (img.width() - 1)) x = img.width() - 1;
 				if (y > (img.height() - 1)) y = img.height() - 1;
 
-				return img.data()[int(y) * img.width() + int(x)];
+				return img.row(int(y))[int(x)];
 			}
 		}
 
+		void ImagePoint(const voi::ImageView& img, int x, int y) {
+			if (img.premultiplied()) PointPremultiplied(x, y);
+			else Point(x, y);
+		}
+
+		/*premultiplied texels interpolate as they are, straight ones need their colors weighted by alpha*/
+		voi::Pixel TexelLerp(const voi::ImageView& img, const voi::Pixel& a, const voi::Pixel& b, float alpha) {
+			return img.premultiplied() ? voi::Pixel::lerp(a, b, alpha) : BLAlphaCorrectLerp(a, b, alpha);
+		}
+
 		voi::Pixel BLAlphaCorrectLerp(const voi::Pixel& a, const voi::Pixel& b, float alpha) {
 			int intAlpha = alpha * 256;
 			int colorIntAlpha;
@@ -2223,6 +2470,8 @@ namespace voi{
 			pixelBuffer = (MapPixel*)(buffInf.buffer);
 			context = GetDC(this->winHandle);
 
+			ResetRenderTarget();
+
 			ts1 = std::chrono::system_clock::now();
 			ts2 = ts1;
 			tStart = ts1;
@@ -2248,8 +2497,15 @@ namespace voi{
 					PullPadState();
 				}
 
+				//key and mouse state stay fixed for the rest of the frame
+				DrainInput();
+
+				if (assets) assets->Deliver();
+
 				OnUpdate(deltaTime);
 
+				if (capture) capture->Frame(pixelBuffer, buffInf.width, buffInf.height, _frameCount);
+
 				this->UpdateScreen(context);
 
 				_frameCount++;